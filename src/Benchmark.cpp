@@ -0,0 +1,197 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <numeric>
+
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+void Benchmark::Start(const Settings& BenchSettings)
+{
+    m_Settings           = BenchSettings;
+    m_IsRunning          = true;
+    m_FrameSamplesPaused = false;
+    m_FrameIndex         = 0;
+    m_Samples.clear();
+
+    LOG_INFO_MESSAGE("Benchmark started: ", m_Settings.NumWarmupFrames, " warm-up frames, ", m_Settings.NumFrames, " measured frames");
+}
+
+bool Benchmark::NextFrame()
+{
+    if (!m_IsRunning)
+        return false;
+
+    ++m_FrameIndex;
+    return m_Settings.NumFrames == 0 || m_FrameIndex < m_Settings.NumWarmupFrames + m_Settings.NumFrames;
+}
+
+void Benchmark::AddSample(const Char* Metric, double ValueMs)
+{
+    if (m_IsRunning && !IsWarmingUp() && !m_FrameSamplesPaused)
+        m_Samples[Metric].push_back(ValueMs);
+}
+
+void Benchmark::AddMicroBenchSample(const Char* Metric, double ValueMs)
+{
+    if (m_IsRunning)
+        m_Samples[Metric].push_back(ValueMs);
+}
+
+Benchmark::MetricMap Benchmark::GetResults() const
+{
+    MetricMap Results;
+    for (const auto& It : m_Samples)
+    {
+        auto Samples = It.second;
+        if (Samples.empty())
+            continue;
+
+        const double Mean = std::accumulate(Samples.begin(), Samples.end(), 0.0) / static_cast<double>(Samples.size());
+
+        const size_t P95Idx = std::min(Samples.size() - 1, (Samples.size() * 95) / 100);
+        std::nth_element(Samples.begin(), Samples.begin() + P95Idx, Samples.end());
+
+        Results[It.first + ".MeanMs"] = Mean;
+        Results[It.first + ".P95Ms"]  = Samples[P95Idx];
+    }
+    return Results;
+}
+
+bool Benchmark::Finish()
+{
+    if (!m_IsRunning)
+        return false;
+    m_IsRunning = false;
+
+    const auto Results = GetResults();
+    for (const auto& It : Results)
+        LOG_INFO_MESSAGE(It.first, ": ", It.second);
+
+    if (!m_Settings.OutputFilePath.empty())
+        WriteResults(m_Settings.OutputFilePath.c_str(), Results, m_Settings.DefaultTolerance);
+
+    if (m_Settings.BaselineFilePath.empty())
+        return true;
+
+    BaselineMap Baseline;
+    if (!LoadBaseline(m_Settings.BaselineFilePath.c_str(), m_Settings.DefaultTolerance, Baseline))
+        return false;
+
+    return CompareWithBaseline(Results, Baseline);
+}
+
+bool Benchmark::LoadBaseline(const Char* FilePath, double DefaultTolerance, BaselineMap& Baseline)
+{
+    std::ifstream Stream{FilePath};
+    if (!Stream)
+    {
+        LOG_ERROR_MESSAGE("Failed to open benchmark baseline '", FilePath, "'");
+        return false;
+    }
+
+    std::string Line;
+    for (int LineNum = 1; std::getline(Stream, Line); ++LineNum)
+    {
+        std::istringstream LineStream{Line};
+
+        std::string Metric;
+        if (!(LineStream >> Metric) || Metric[0] == '#')
+            continue;
+
+        BaselineEntry Entry;
+        if (!(LineStream >> Entry.Value))
+        {
+            LOG_ERROR_MESSAGE(FilePath, '(', LineNum, "): missing value for metric '", Metric, "'");
+            return false;
+        }
+        if (!(LineStream >> Entry.Tolerance))
+            Entry.Tolerance = DefaultTolerance;
+
+        Baseline[Metric] = Entry;
+    }
+
+    return true;
+}
+
+bool Benchmark::WriteResults(const Char* FilePath, const MetricMap& Results, double Tolerance)
+{
+    std::ofstream Stream{FilePath};
+    if (!Stream)
+    {
+        LOG_ERROR_MESSAGE("Failed to open benchmark output file '", FilePath, "'");
+        return false;
+    }
+
+    Stream << "# <Metric> <Value, ms> <Relative tolerance>\n";
+    for (const auto& It : Results)
+        Stream << It.first << ' ' << It.second << ' ' << Tolerance << '\n';
+
+    return static_cast<bool>(Stream);
+}
+
+bool Benchmark::CompareWithBaseline(const MetricMap& Results, const BaselineMap& Baseline)
+{
+    bool Passed = true;
+    for (const auto& It : Baseline)
+    {
+        const auto& Metric = It.first;
+        const auto& Entry  = It.second;
+
+        auto ResultIt = Results.find(Metric);
+        if (ResultIt == Results.end())
+        {
+            LOG_ERROR_MESSAGE("Metric '", Metric, "' from the baseline was not measured");
+            Passed = false;
+            continue;
+        }
+
+        const double Value = ResultIt->second;
+        const double Limit = Entry.Value * (1.0 + Entry.Tolerance);
+        if (Value > Limit)
+        {
+            LOG_ERROR_MESSAGE("Performance regression: ", Metric, " = ", Value, " ms exceeds baseline ", Entry.Value,
+                              " ms by more than ", Entry.Tolerance * 100.0, "%");
+            Passed = false;
+        }
+        else if (Value < Entry.Value * (1.0 - Entry.Tolerance))
+        {
+            LOG_INFO_MESSAGE(Metric, " = ", Value, " ms is faster than baseline ", Entry.Value, " ms. Consider updating the baseline.");
+        }
+    }
+
+    return Passed;
+}
+
+} // namespace Diligent
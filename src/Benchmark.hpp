@@ -0,0 +1,102 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BasicTypes.h"
+
+namespace Diligent
+{
+
+// Collects per-frame timing samples of a headless benchmark run and compares
+// the results against a stored baseline.
+//
+// Baseline and result files are plain text with one metric per line:
+//      <Metric> <Value> [<Relative tolerance>]
+// Lines starting with '#' are ignored. All metrics are timings in milliseconds,
+// so a metric regresses when its value exceeds Value * (1 + Tolerance).
+class Benchmark
+{
+public:
+    struct Settings
+    {
+        Uint32      NumWarmupFrames         = 30;
+        Uint32      NumFrames               = 0;
+        Uint32      NumMicroBenchIterations = 100;
+        double      DefaultTolerance        = 0.1;
+        std::string BaselineFilePath;
+        std::string OutputFilePath;
+    };
+
+    struct BaselineEntry
+    {
+        double Value     = 0;
+        double Tolerance = 0;
+    };
+    using MetricMap   = std::map<std::string, double>;
+    using BaselineMap = std::map<std::string, BaselineEntry>;
+
+    void Start(const Settings& BenchSettings);
+    bool IsRunning() const { return m_IsRunning; }
+    bool IsWarmingUp() const { return m_FrameIndex < m_Settings.NumWarmupFrames; }
+
+    // Advances the frame counter. Returns false once all frames have been measured.
+    bool NextFrame();
+
+    // Samples are ignored during warm-up frames and while frame samples are paused
+    void AddSample(const Char* Metric, double ValueMs);
+    // Pauses frame samples while microbenchmarks render frames that must not be measured
+    void SetFrameSamplesPaused(bool Paused) { m_FrameSamplesPaused = Paused; }
+    // Microbenchmark samples are recorded regardless of the warm-up state
+    void AddMicroBenchSample(const Char* Metric, double ValueMs);
+
+    const Settings& GetSettings() const { return m_Settings; }
+
+    // Computes mean and 95th percentile of every metric, writes the results
+    // and compares them against the baseline. Returns true if no metric regressed.
+    bool Finish();
+
+    MetricMap GetResults() const;
+
+    static bool LoadBaseline(const Char* FilePath, double DefaultTolerance, BaselineMap& Baseline);
+    static bool WriteResults(const Char* FilePath, const MetricMap& Results, double Tolerance);
+    static bool CompareWithBaseline(const MetricMap& Results, const BaselineMap& Baseline);
+
+private:
+    Settings m_Settings;
+    bool     m_IsRunning          = false;
+    bool     m_FrameSamplesPaused = false;
+    Uint32   m_FrameIndex         = 0;
+
+    std::map<std::string, std::vector<double>> m_Samples;
+};
+
+} // namespace Diligent
@@ -0,0 +1,81 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include "BasicTypes.h"
+
+namespace Diligent
+{
+
+// Counter-based random number generator Philox4x32-10 (J. Salmon et al., "Parallel Random Numbers:
+// As Easy as 1, 2, 3", SC'11). Every output block is a pure function of a 128-bit counter and a 64-bit
+// key, so random numbers for any element can be generated independently, in any order and on any
+// thread, and the results do not depend on how the work is distributed.
+struct Philox4x32
+{
+    struct Block
+    {
+        Uint32 v[4];
+    };
+
+    static constexpr Block Generate(Block Counter, Uint32 Key0, Uint32 Key1)
+    {
+        for (int Round = 0; Round < 10; ++Round)
+        {
+            if (Round > 0)
+            {
+                Key0 += 0x9E3779B9u;
+                Key1 += 0xBB67AE85u;
+            }
+            const Uint64 Prod0 = Uint64{0xD2511F53u} * Counter.v[0];
+            const Uint64 Prod1 = Uint64{0xCD9E8D57u} * Counter.v[2];
+
+            Counter = Block{{static_cast<Uint32>(Prod1 >> 32u) ^ Counter.v[1] ^ Key0,
+                             static_cast<Uint32>(Prod1),
+                             static_cast<Uint32>(Prod0 >> 32u) ^ Counter.v[3] ^ Key1,
+                             static_cast<Uint32>(Prod0)}};
+        }
+        return Counter;
+    }
+
+    // Generates a block for the given element index and stream within that element
+    static constexpr Block Generate(Uint64 Index, Uint32 Stream, Uint64 Seed)
+    {
+        return Generate(Block{{static_cast<Uint32>(Index), static_cast<Uint32>(Index >> 32u), Stream, 0}},
+                        static_cast<Uint32>(Seed), static_cast<Uint32>(Seed >> 32u));
+    }
+};
+
+// Maps 32 random bits to a float uniformly distributed in [Min, Max)
+constexpr float UniformFloat(Uint32 Bits, float Min, float Max)
+{
+    // 24 bits fit exactly into the float mantissa
+    return Min + (Max - Min) * static_cast<float>(Bits >> 8u) * (1.f / 16777216.f);
+}
+
+} // namespace Diligent
@@ -0,0 +1,107 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "DepthSorter.hpp"
+
+#include <cstring>
+
+namespace Diligent
+{
+
+namespace
+{
+
+constexpr Uint32 RadixBits = 8;
+constexpr Uint32 RadixSize = 1u << RadixBits;
+constexpr Uint32 NumPasses = 32 / RadixBits;
+constexpr Uint32 RadixMask = RadixSize - 1;
+
+// Maps a float to an unsigned integer with the same ordering: negative values are
+// inverted and positive values get the sign bit set
+Uint32 FloatToSortableKey(float Value)
+{
+    Uint32 Bits = 0;
+    std::memcpy(&Bits, &Value, sizeof(Bits));
+    return (Bits & 0x80000000u) != 0 ? ~Bits : (Bits | 0x80000000u);
+}
+
+} // namespace
+
+const std::vector<Uint32>& DepthSorter::Sort(const float4x4* pInstances, size_t NumInstances, const float4x4& ViewProj)
+{
+    m_Keys.resize(NumInstances);
+    m_Order.resize(NumInstances);
+    m_TmpKeys.resize(NumInstances);
+    m_TmpOrder.resize(NumInstances);
+
+    // Histograms of all digits are computed in the same pass that computes the keys
+    Uint32 Histograms[NumPasses][RadixSize] = {};
+    for (size_t i = 0; i < NumInstances; ++i)
+    {
+        // Instance origin is in the last row of the instance matrix
+        const auto& Inst  = pInstances[i];
+        const float Depth = Inst._41 * ViewProj._14 + Inst._42 * ViewProj._24 + Inst._43 * ViewProj._34 + ViewProj._44;
+        const auto  Key   = FloatToSortableKey(Depth);
+
+        m_Keys[i]  = Key;
+        m_Order[i] = static_cast<Uint32>(i);
+        for (Uint32 Pass = 0; Pass < NumPasses; ++Pass)
+            ++Histograms[Pass][(Key >> (Pass * RadixBits)) & RadixMask];
+    }
+
+    for (Uint32 Pass = 0; Pass < NumPasses && NumInstances > 0; ++Pass)
+    {
+        const Uint32 Shift     = Pass * RadixBits;
+        auto&        Histogram = Histograms[Pass];
+
+        // The pass would not change the order if all keys have the same digit
+        if (Histogram[(m_Keys[0] >> Shift) & RadixMask] == NumInstances)
+            continue;
+
+        Uint32 Offsets[RadixSize];
+        Uint32 Offset = 0;
+        for (Uint32 d = 0; d < RadixSize; ++d)
+        {
+            Offsets[d] = Offset;
+            Offset += Histogram[d];
+        }
+
+        // Scattering is stable, so the order of the previous passes is preserved within every digit
+        for (size_t i = 0; i < NumInstances; ++i)
+        {
+            const Uint32 Dst = Offsets[(m_Keys[i] >> Shift) & RadixMask]++;
+            m_TmpKeys[Dst]   = m_Keys[i];
+            m_TmpOrder[Dst]  = m_Order[i];
+        }
+        m_Keys.swap(m_TmpKeys);
+        m_Order.swap(m_TmpOrder);
+    }
+
+    return m_Order;
+}
+
+} // namespace Diligent
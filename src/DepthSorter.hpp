@@ -0,0 +1,58 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "BasicMath.hpp"
+
+namespace Diligent
+{
+
+// Orders instances front to back with an LSD radix sort on their view-space depth,
+// so that early depth testing rejects the fragments of hidden instances.
+class DepthSorter
+{
+public:
+    // Sorts the instances by the clip-space w of their origins, which is the view-space depth
+    // for perspective projections. Returns the instance indices in drawing order. The result
+    // stays valid until the next call.
+    const std::vector<Uint32>& Sort(const float4x4* pInstances, size_t NumInstances, const float4x4& ViewProj);
+
+    // Order computed by the last call to Sort()
+    const std::vector<Uint32>& GetOrder() const { return m_Order; }
+
+private:
+    std::vector<Uint32> m_Keys;
+    std::vector<Uint32> m_Order;
+    // Destination of every other radix pass
+    std::vector<Uint32> m_TmpKeys;
+    std::vector<Uint32> m_TmpOrder;
+};
+
+} // namespace Diligent
@@ -0,0 +1,227 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "FrameRecorder.hpp"
+
+#include <cstring>
+#include <iterator>
+
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+namespace
+{
+
+constexpr Uint8  FileMagic[4] = {'T', '4', 'F', 'R'};
+constexpr Uint32 FileVersion  = 5;
+
+constexpr size_t GetFrameSize(Uint32 Version)
+{
+    return sizeof(double) + sizeof(double) + sizeof(Uint8) + sizeof(Uint32) + (Version >= 2 ? sizeof(Uint8) : 0) + (Version >= 3 ? sizeof(Uint32) : 0) +
+        (Version >= 4 ? 2 * sizeof(Uint8) : 0) + (Version >= 5 ? sizeof(float) : 0);
+}
+
+// Bits of the render settings byte
+enum RENDER_SETTING_BIT : Uint8
+{
+    RENDER_SETTING_BIT_ANIMATE           = 1u << 0,
+    RENDER_SETTING_BIT_VERTEX_PULLING    = 1u << 1,
+    RENDER_SETTING_BIT_DEPTH_SORT        = 1u << 2,
+    RENDER_SETTING_BIT_DEPTH_PREPASS     = 1u << 3,
+    RENDER_SETTING_BIT_OCCLUSION_CULLING = 1u << 4
+};
+
+// Values are stored in little-endian order regardless of the host
+template <typename T>
+void WriteValue(Uint8*& pDst, T Value)
+{
+    static_assert(sizeof(T) <= sizeof(Uint64), "Unsupported value type");
+    Uint64 Bits = 0;
+    std::memcpy(&Bits, &Value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); ++i)
+        *pDst++ = static_cast<Uint8>(Bits >> (i * 8));
+}
+
+template <typename T>
+T ReadValue(const Uint8*& pSrc)
+{
+    static_assert(sizeof(T) <= sizeof(Uint64), "Unsupported value type");
+    Uint64 Bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        Bits |= static_cast<Uint64>(*pSrc++) << (i * 8);
+    T Value;
+    std::memcpy(&Value, &Bits, sizeof(T));
+    return Value;
+}
+
+} // namespace
+
+bool FrameRecorder::StartRecording(const Char* FilePath)
+{
+    StopRecording();
+
+    m_RecordStream.open(FilePath, std::ios::binary | std::ios::trunc);
+    if (!m_RecordStream)
+    {
+        LOG_ERROR_MESSAGE("Failed to open frame log '", FilePath, "' for writing");
+        return false;
+    }
+
+    Uint8  Header[sizeof(FileMagic) + sizeof(Uint32)];
+    Uint8* pDst = Header;
+    for (auto c : FileMagic)
+        WriteValue(pDst, c);
+    WriteValue(pDst, FileVersion);
+    m_RecordStream.write(reinterpret_cast<const char*>(Header), sizeof(Header));
+
+    m_NumRecordedFrames = 0;
+    return true;
+}
+
+void FrameRecorder::RecordFrame(const RecordedFrame& Frame)
+{
+    if (!IsRecording())
+        return;
+
+    Uint8  Data[GetFrameSize(FileVersion)];
+    Uint8* pDst = Data;
+    WriteValue(pDst, Frame.CurrTime);
+    WriteValue(pDst, Frame.ElapsedTime);
+    WriteValue(pDst, static_cast<Uint8>(Frame.CameraMode));
+    WriteValue(pDst, static_cast<Uint32>(Frame.GridSize));
+    WriteValue(pDst, static_cast<Uint8>(Frame.SceneMode));
+    WriteValue(pDst, static_cast<Uint32>(Frame.NumMobiles));
+
+    Uint8 Settings = 0;
+    Settings |= Frame.Animate ? RENDER_SETTING_BIT_ANIMATE : 0;
+    Settings |= Frame.VertexPulling ? RENDER_SETTING_BIT_VERTEX_PULLING : 0;
+    Settings |= Frame.DepthSort ? RENDER_SETTING_BIT_DEPTH_SORT : 0;
+    Settings |= Frame.DepthPrepass ? RENDER_SETTING_BIT_DEPTH_PREPASS : 0;
+    Settings |= Frame.OcclusionCulling ? RENDER_SETTING_BIT_OCCLUSION_CULLING : 0;
+    WriteValue(pDst, static_cast<Uint8>(Frame.MobileInstancing));
+    WriteValue(pDst, Settings);
+    WriteValue(pDst, Frame.MobileAngle);
+    VERIFY_EXPR(pDst == Data + sizeof(Data));
+    m_RecordStream.write(reinterpret_cast<const char*>(Data), sizeof(Data));
+    ++m_NumRecordedFrames;
+}
+
+void FrameRecorder::StopRecording()
+{
+    if (!IsRecording())
+        return;
+
+    m_RecordStream.close();
+    LOG_INFO_MESSAGE("Recorded ", m_NumRecordedFrames, " frames");
+}
+
+bool FrameRecorder::LoadReplay(const Char* FilePath)
+{
+    StopReplay();
+
+    std::ifstream Stream{FilePath, std::ios::binary};
+    if (!Stream)
+    {
+        LOG_ERROR_MESSAGE("Failed to open frame log '", FilePath, "'");
+        return false;
+    }
+    const std::vector<Uint8> Data{std::istreambuf_iterator<char>{Stream}, std::istreambuf_iterator<char>{}};
+
+    constexpr size_t HeaderSize = sizeof(FileMagic) + sizeof(Uint32);
+    if (Data.size() < HeaderSize || std::memcmp(Data.data(), FileMagic, sizeof(FileMagic)) != 0)
+    {
+        LOG_ERROR_MESSAGE("'", FilePath, "' is not a valid frame log");
+        return false;
+    }
+
+    const Uint8* pSrc    = Data.data() + sizeof(FileMagic);
+    const auto   Version = ReadValue<Uint32>(pSrc);
+    if (Version == 0 || Version > FileVersion)
+    {
+        LOG_ERROR_MESSAGE("Unsupported frame log version ", Version, " in '", FilePath, "'");
+        return false;
+    }
+
+    const size_t FrameSize = GetFrameSize(Version);
+    const size_t NumFrames = (Data.size() - HeaderSize) / FrameSize;
+    if ((Data.size() - HeaderSize) % FrameSize != 0)
+        LOG_WARNING_MESSAGE("Frame log '", FilePath, "' is truncated. The incomplete last frame is ignored.");
+
+    m_ReplayFrames.resize(NumFrames);
+    for (auto& Frame : m_ReplayFrames)
+    {
+        Frame.CurrTime    = ReadValue<double>(pSrc);
+        Frame.ElapsedTime = ReadValue<double>(pSrc);
+        Frame.CameraMode  = ReadValue<Uint8>(pSrc);
+        Frame.GridSize    = static_cast<Int32>(ReadValue<Uint32>(pSrc));
+        Frame.SceneMode   = Version >= 2 ? ReadValue<Uint8>(pSrc) : 0;
+        Frame.NumMobiles  = Version >= 3 ? static_cast<Int32>(ReadValue<Uint32>(pSrc)) : 0;
+
+        Frame.HasRenderSettings = Version >= 4;
+        if (Frame.HasRenderSettings)
+        {
+            Frame.MobileInstancing = ReadValue<Uint8>(pSrc);
+
+            const auto Settings    = ReadValue<Uint8>(pSrc);
+            Frame.Animate          = (Settings & RENDER_SETTING_BIT_ANIMATE) != 0;
+            Frame.VertexPulling    = (Settings & RENDER_SETTING_BIT_VERTEX_PULLING) != 0;
+            Frame.DepthSort        = (Settings & RENDER_SETTING_BIT_DEPTH_SORT) != 0;
+            Frame.DepthPrepass     = (Settings & RENDER_SETTING_BIT_DEPTH_PREPASS) != 0;
+            Frame.OcclusionCulling = (Settings & RENDER_SETTING_BIT_OCCLUSION_CULLING) != 0;
+        }
+
+        Frame.HasMobileAngle = Version >= 5;
+        if (Frame.HasMobileAngle)
+            Frame.MobileAngle = ReadValue<float>(pSrc);
+    }
+    m_ReplayPos = 0;
+
+    LOG_INFO_MESSAGE("Loaded ", NumFrames, " frames from '", FilePath, "'");
+    return !m_ReplayFrames.empty();
+}
+
+bool FrameRecorder::ReplayFrame(RecordedFrame& Frame)
+{
+    if (m_ReplayPos >= m_ReplayFrames.size())
+    {
+        StopReplay();
+        return false;
+    }
+
+    Frame = m_ReplayFrames[m_ReplayPos++];
+    return true;
+}
+
+void FrameRecorder::StopReplay()
+{
+    m_ReplayFrames.clear();
+    m_ReplayPos = 0;
+}
+
+} // namespace Diligent
@@ -0,0 +1,98 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <vector>
+
+#include "BasicTypes.h"
+
+namespace Diligent
+{
+
+// Per-frame state that drives the sample. Replaying a recorded sequence
+// reproduces exactly the same workload regardless of the actual frame timing.
+struct RecordedFrame
+{
+    double CurrTime    = 0;
+    double ElapsedTime = 0;
+    Int32  CameraMode  = 0;
+    Int32  GridSize    = 0;
+    Int32  SceneMode   = 0;
+    Int32  NumMobiles  = 0;
+
+    // Render settings that change the workload. Logs older than version 4 do not store them,
+    // in which case HasRenderSettings is false and the live settings are kept.
+    bool  HasRenderSettings = false;
+    Int32 MobileInstancing  = 0;
+    bool  Animate           = true;
+    bool  VertexPulling     = false;
+    bool  DepthSort         = false;
+    bool  DepthPrepass      = false;
+    bool  OcclusionCulling  = false;
+
+    // Angle of the mobiles rendered in the frame. It is produced by the simulation thread and depends
+    // on its timing, so it is recorded as well (since version 5).
+    bool  HasMobileAngle = false;
+    float MobileAngle    = 0;
+};
+
+// Records per-frame state to a compact binary log and plays it back.
+//
+// File layout (little-endian):
+//      Header: 'T4FR' magic, Uint32 version
+//      Frames: f64 CurrTime, f64 ElapsedTime, u8 CameraMode, u32 GridSize, u8 SceneMode (since version 2),
+//              u32 NumMobiles (since version 3), u8 MobileInstancing and u8 render setting bits
+//              (since version 4: Animate, VertexPulling, DepthSort, DepthPrepass, OcclusionCulling),
+//              f32 MobileAngle (since version 5)
+class FrameRecorder
+{
+public:
+    bool   StartRecording(const Char* FilePath);
+    void   RecordFrame(const RecordedFrame& Frame);
+    void   StopRecording();
+    bool   IsRecording() const { return m_RecordStream.is_open(); }
+    Uint64 GetNumRecordedFrames() const { return m_NumRecordedFrames; }
+
+    bool LoadReplay(const Char* FilePath);
+    // Returns the next recorded frame. When the log is exhausted, replay stops and false is returned.
+    bool   ReplayFrame(RecordedFrame& Frame);
+    void   StopReplay();
+    bool   IsReplaying() const { return !m_ReplayFrames.empty(); }
+    size_t GetReplayPosition() const { return m_ReplayPos; }
+    size_t GetNumReplayFrames() const { return m_ReplayFrames.size(); }
+
+private:
+    std::ofstream m_RecordStream;
+    Uint64        m_NumRecordedFrames = 0;
+
+    std::vector<RecordedFrame> m_ReplayFrames;
+    size_t                     m_ReplayPos = 0;
+};
+
+} // namespace Diligent
@@ -0,0 +1,177 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+JobSystem::JobSystem(Uint32 NumWorkers)
+{
+    if (NumWorkers == DefaultNumWorkers)
+        NumWorkers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+    m_Queues.reserve(NumWorkers + 1);
+    for (Uint32 i = 0; i < NumWorkers + 1; ++i)
+        m_Queues.emplace_back(std::make_unique<TaskQueue>());
+
+    m_Workers.reserve(NumWorkers);
+    for (Uint32 i = 0; i < NumWorkers; ++i)
+        m_Workers.emplace_back(&JobSystem::WorkerThreadFunc, this, size_t{i} + 1);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> Lock{m_WakeMtx};
+        m_Stop = true;
+    }
+    m_WakeCV.notify_all();
+
+    for (auto& Worker : m_Workers)
+        Worker.join();
+}
+
+bool JobSystem::PopOrSteal(size_t QueueIdx, Task& OutTask)
+{
+    if (m_NumQueuedTasks.load(std::memory_order_acquire) == 0)
+        return false;
+
+    // Take the most recently pushed task from the own queue first as its data is most likely in cache
+    {
+        auto&                       Queue = *m_Queues[QueueIdx];
+        std::lock_guard<std::mutex> Lock{Queue.Mtx};
+        if (!Queue.Tasks.empty())
+        {
+            OutTask = Queue.Tasks.back();
+            Queue.Tasks.pop_back();
+            m_NumQueuedTasks.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+
+    // Steal the oldest task from another queue
+    for (size_t i = 1; i < m_Queues.size(); ++i)
+    {
+        auto&                       Victim = *m_Queues[(QueueIdx + i) % m_Queues.size()];
+        std::lock_guard<std::mutex> Lock{Victim.Mtx};
+        if (!Victim.Tasks.empty())
+        {
+            OutTask = Victim.Tasks.front();
+            Victim.Tasks.pop_front();
+            m_NumQueuedTasks.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::ExecuteTask(const Task& T)
+{
+    (*T.pFunc)(T.Begin, T.End);
+    T.pRemaining->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::WorkerThreadFunc(size_t QueueIdx)
+{
+    for (;;)
+    {
+        Task T;
+        if (PopOrSteal(QueueIdx, T))
+        {
+            ExecuteTask(T);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> Lock{m_WakeMtx};
+        m_WakeCV.wait(Lock, [this] { return m_Stop || m_NumQueuedTasks.load(std::memory_order_acquire) > 0; });
+        if (m_Stop)
+            return;
+    }
+}
+
+void JobSystem::ParallelFor(Uint64 Count, Uint64 ChunkSize, const ChunkFunc& Func)
+{
+    if (Count == 0)
+        return;
+
+    ChunkSize = std::max(ChunkSize, Uint64{1});
+    const Uint64 NumChunks = (Count + ChunkSize - 1) / ChunkSize;
+    if (NumChunks == 1 || m_Workers.empty())
+    {
+        // Not worth the synchronization overhead
+        Func(0, Count);
+        return;
+    }
+
+    std::atomic<Uint64> Remaining{NumChunks};
+
+    // Distribute the chunks evenly between all queues. Contiguous ranges go to the same
+    // queue, so that every thread writes to its own region of memory unless it steals.
+    const Uint64 NumQueues = m_Queues.size();
+    for (Uint64 q = 0; q < NumQueues; ++q)
+    {
+        const Uint64 FirstChunk = NumChunks * q / NumQueues;
+        const Uint64 EndChunk   = NumChunks * (q + 1) / NumQueues;
+
+        auto&                       Queue = *m_Queues[q];
+        std::lock_guard<std::mutex> Lock{Queue.Mtx};
+        // Push in reverse order so that the owner pops chunks front to back
+        for (Uint64 c = EndChunk; c > FirstChunk; --c)
+        {
+            Task T;
+            T.pFunc      = &Func;
+            T.Begin      = (c - 1) * ChunkSize;
+            T.End        = std::min(c * ChunkSize, Count);
+            T.pRemaining = &Remaining;
+            Queue.Tasks.push_back(T);
+        }
+    }
+    {
+        // Counter is updated under the mutex to make sure that no worker misses the wake-up
+        std::lock_guard<std::mutex> Lock{m_WakeMtx};
+        m_NumQueuedTasks.fetch_add(NumChunks, std::memory_order_acq_rel);
+    }
+    m_WakeCV.notify_all();
+
+    // The calling thread works too and then waits for the chunks that are still running on other threads
+    while (Remaining.load(std::memory_order_acquire) > 0)
+    {
+        Task T;
+        if (PopOrSteal(0, T))
+            ExecuteTask(T);
+        else
+            std::this_thread::yield();
+    }
+}
+
+} // namespace Diligent
@@ -0,0 +1,100 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BasicTypes.h"
+
+namespace Diligent
+{
+
+// Minimal work-stealing job system. Every thread owns a task deque: the owner takes tasks
+// from the back of its own deque, while idle threads steal from the front of other deques.
+// The thread that calls ParallelFor() participates in the work and uses deque 0.
+class JobSystem
+{
+public:
+    // Chunk function receives a half-open range [Begin, End)
+    using ChunkFunc = std::function<void(Uint64 Begin, Uint64 End)>;
+
+    // NumWorkers is the number of threads in addition to the calling thread.
+    // 0xFFFFFFFF selects one worker per hardware thread except the calling one.
+    static constexpr Uint32 DefaultNumWorkers = ~Uint32{0};
+
+    explicit JobSystem(Uint32 NumWorkers = DefaultNumWorkers);
+    ~JobSystem();
+
+    // clang-format off
+    JobSystem           (const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    // clang-format on
+
+    // The number of threads that execute tasks, including the calling thread
+    Uint32 GetNumThreads() const { return static_cast<Uint32>(m_Workers.size()) + 1; }
+
+    // Splits [0, Count) into chunks of at most ChunkSize elements, runs Func for every
+    // chunk and returns when all chunks are done. Must not be called concurrently.
+    void ParallelFor(Uint64 Count, Uint64 ChunkSize, const ChunkFunc& Func);
+
+private:
+    struct Task
+    {
+        const ChunkFunc*     pFunc      = nullptr;
+        Uint64               Begin      = 0;
+        Uint64               End        = 0;
+        std::atomic<Uint64>* pRemaining = nullptr;
+    };
+
+    struct TaskQueue
+    {
+        std::mutex       Mtx;
+        std::deque<Task> Tasks;
+    };
+
+    bool PopOrSteal(size_t QueueIdx, Task& OutTask);
+    void ExecuteTask(const Task& T);
+    void WorkerThreadFunc(size_t QueueIdx);
+
+    std::vector<std::unique_ptr<TaskQueue>> m_Queues;
+    std::vector<std::thread>                m_Workers;
+
+    std::mutex              m_WakeMtx;
+    std::condition_variable m_WakeCV;
+    std::atomic<Uint64>     m_NumQueuedTasks{0};
+    bool                    m_Stop = false;
+};
+
+} // namespace Diligent
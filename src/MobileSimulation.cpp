@@ -0,0 +1,195 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "MobileSimulation.hpp"
+
+#include <algorithm>
+
+#include "Profiler.hpp"
+
+namespace Diligent
+{
+
+MobileSimulation::MobileSimulation(float InitialAngle) :
+    m_PrevAngle{InitialAngle},
+    m_Angle{InitialAngle}
+{
+    // The thread is started last as it accesses the members
+    m_Thread = std::thread{&MobileSimulation::ThreadFunc, this};
+}
+
+MobileSimulation::~MobileSimulation()
+{
+    {
+        std::lock_guard<std::mutex> Lock{m_Mtx};
+        m_Stop = true;
+    }
+    m_WakeCV.notify_one();
+    m_Thread.join();
+}
+
+void MobileSimulation::SetLayout(const std::vector<MobilePlacement>& Placements, bool ExpandInstances, Uint64 Version)
+{
+    {
+        std::lock_guard<std::mutex> Lock{m_Mtx};
+        m_PendingPlacements      = Placements;
+        m_PendingExpandInstances = ExpandInstances;
+        m_PendingLayoutVersion   = Version;
+    }
+    m_WakeCV.notify_one();
+}
+
+Uint64 MobileSimulation::Kick(double Time)
+{
+    Uint64 KickIndex = 0;
+    {
+        std::lock_guard<std::mutex> Lock{m_Mtx};
+        m_RequestedTime = Time;
+        KickIndex       = ++m_NumKicks;
+    }
+    m_WakeCV.notify_one();
+    return KickIndex;
+}
+
+void MobileSimulation::WaitForSnapshot(Uint64 KickIndex)
+{
+    std::unique_lock<std::mutex> Lock{m_Mtx};
+    m_PublishedCV.wait(Lock, [&] { return m_NumPublishedKicks >= KickIndex; });
+}
+
+void MobileSimulation::Reset(double Time, float Angle)
+{
+    {
+        std::lock_guard<std::mutex> Lock{m_Mtx};
+        m_ResetPending  = true;
+        m_ResetTime     = Time;
+        m_ResetAngle    = Angle;
+        m_RequestedTime = Time;
+    }
+    m_WakeCV.notify_one();
+}
+
+const MobileSnapshot& MobileSimulation::AcquireSnapshot()
+{
+    m_Snapshots.Acquire();
+    return m_Snapshots.GetReadBuffer();
+}
+
+void MobileSimulation::ThreadFunc()
+{
+    for (;;)
+    {
+        double TargetTime   = 0;
+        Uint64 HandledKicks = 0;
+        {
+            std::unique_lock<std::mutex> Lock{m_Mtx};
+            m_WakeCV.wait(Lock, [this] { return m_Stop || m_NumKicks != m_NumHandledKicks || m_PendingLayoutVersion != m_LayoutVersion || m_ResetPending; });
+            if (m_Stop)
+                return;
+
+            if (m_PendingLayoutVersion != m_LayoutVersion)
+            {
+                m_Placements.swap(m_PendingPlacements);
+                m_ExpandInstances = m_PendingExpandInstances;
+                m_LayoutVersion   = m_PendingLayoutVersion;
+            }
+            if (m_ResetPending)
+            {
+                m_SimTime      = m_ResetTime;
+                m_PrevAngle    = m_ResetAngle;
+                m_Angle        = m_ResetAngle;
+                m_ClockStarted = true;
+                m_ResetPending = false;
+            }
+            m_NumHandledKicks = m_NumKicks;
+            HandledKicks      = m_NumKicks;
+            TargetTime        = m_RequestedTime;
+        }
+
+        T4_PROFILE_ZONE("SimulateMobiles");
+
+        if (!m_ClockStarted)
+        {
+            m_SimTime      = TargetTime;
+            m_ClockStarted = true;
+        }
+        else if (TargetTime <= m_SimTime - StepDuration)
+        {
+            // The time went backwards, e.g. because a replay started with an earlier time. No step would be
+            // taken until the time passes the simulated time again, so the clock restarts at the requested time.
+            m_SimTime   = TargetTime;
+            m_PrevAngle = m_Angle;
+        }
+
+        // Kicks that were requested while the thread was busy are coalesced, and the simulation
+        // catches up in fixed steps, so the motion does not depend on the frame rate
+        const float AngleStep = m_Animate.load(std::memory_order_relaxed) ? AngularVelocity * static_cast<float>(StepDuration) : 0.f;
+        Uint32      NumSteps  = 0;
+        for (; m_SimTime < TargetTime && NumSteps < MaxStepsPerKick; ++NumSteps)
+        {
+            m_PrevAngle = m_Angle;
+            m_Angle += AngleStep;
+            m_SimTime += StepDuration;
+        }
+        if (m_SimTime < TargetTime)
+        {
+            m_SimTime   = TargetTime;
+            m_PrevAngle = m_Angle;
+        }
+        m_NumSteps += NumSteps;
+        T4_PROFILE_COUNTER("SimulationSteps", NumSteps);
+
+        // TargetTime lies in (m_SimTime - StepDuration, m_SimTime]
+        const float Alpha = std::clamp(1.f - static_cast<float>((m_SimTime - TargetTime) / StepDuration), 0.f, 1.f);
+        const float Angle = m_PrevAngle + (m_Angle - m_PrevAngle) * Alpha;
+
+        auto& Snapshot         = m_Snapshots.GetWriteBuffer();
+        Snapshot.Version       = ++m_Version;
+        Snapshot.Time          = TargetTime;
+        Snapshot.NumSteps      = m_NumSteps;
+        Snapshot.Angle         = Angle;
+        Snapshot.LayoutVersion = m_LayoutVersion;
+        if (m_ExpandInstances)
+        {
+            Snapshot.Instances.resize(m_Placements.size() * MobileTemplate::NumParts);
+            MobileTemplate::ExpandInstances(m_Placements.data(), Angle, 0, m_Placements.size(), Snapshot.Instances.data());
+        }
+        else
+        {
+            Snapshot.Instances.clear();
+        }
+        m_Snapshots.Publish();
+
+        {
+            std::lock_guard<std::mutex> Lock{m_Mtx};
+            m_NumPublishedKicks = HandledKicks;
+        }
+        m_PublishedCV.notify_all();
+    }
+}
+
+} // namespace Diligent
@@ -0,0 +1,141 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BasicMath.hpp"
+#include "MobileTemplate.hpp"
+#include "TripleBuffer.hpp"
+
+namespace Diligent
+{
+
+// State of all mobiles at the time requested by Kick()
+struct MobileSnapshot
+{
+    // Incremented with every published snapshot. 0 means that nothing has been simulated yet.
+    Uint64 Version = 0;
+    // Time the snapshot presents and the number of fixed steps simulated so far
+    double Time     = 0;
+    Uint64 NumSteps = 0;
+    // Angle interpolated between the two simulation steps around Time
+    float Angle = 0;
+    // Layout version passed to SetLayout() that the instances were expanded for
+    Uint64 LayoutVersion = 0;
+    // Part instances of all mobiles. Empty unless instance expansion is enabled.
+    std::vector<float4x4> Instances;
+};
+
+// Animates the mobiles on a dedicated thread. The simulation advances in fixed time steps,
+// and the state at the requested time is interpolated between the two steps around it.
+// Snapshots are published through a triple buffer, so the render thread does not wait for
+// the simulation unless it asks to, and the simulation never waits for the render thread.
+class MobileSimulation
+{
+public:
+    static constexpr double StepDuration = 1.0 / 60.0;
+    // Radians per second, 0.01 radians per step
+    static constexpr float AngularVelocity = 0.6f;
+    // Bounds the simulation work per Kick(). If the simulation falls further behind, e.g. after
+    // the application has been paused, the remaining time is skipped.
+    static constexpr Uint32 MaxStepsPerKick = 8;
+
+    explicit MobileSimulation(float InitialAngle);
+    ~MobileSimulation();
+
+    // clang-format off
+    MobileSimulation           (const MobileSimulation&) = delete;
+    MobileSimulation& operator=(const MobileSimulation&) = delete;
+    // clang-format on
+
+    // Sets the placements of the mobiles. If ExpandInstances is true, every snapshot also
+    // contains the transforms of all mobile parts. Snapshots produced for the new layout
+    // are tagged with Version.
+    void SetLayout(const std::vector<MobilePlacement>& Placements, bool ExpandInstances, Uint64 Version);
+
+    void SetAnimate(bool Animate) { m_Animate.store(Animate, std::memory_order_relaxed); }
+
+    // Requests the state at the given time and returns immediately. If the time is earlier than the
+    // simulated time, the clock restarts at that time and the simulation continues from the last step.
+    // Returns the index of the request that can be passed to WaitForSnapshot().
+    Uint64 Kick(double Time);
+
+    // Blocks until the snapshot requested by the given Kick() has been published, so that
+    // the next AcquireSnapshot() returns the state at the requested time.
+    void WaitForSnapshot(Uint64 KickIndex);
+
+    // Restarts the simulation clock at the given time with the given angle, e.g. when a replay starts.
+    void Reset(double Time, float Angle);
+
+    // Returns the most recent snapshot. The snapshot stays valid until the next call.
+    const MobileSnapshot& AcquireSnapshot();
+
+private:
+    void ThreadFunc();
+
+    TripleBuffer<MobileSnapshot> m_Snapshots;
+
+    std::atomic<bool> m_Animate{true};
+
+    // Protects the pending layout, the stop flag and the request counters, and is used to wake up the thread
+    std::mutex                   m_Mtx;
+    std::condition_variable      m_WakeCV;
+    std::condition_variable      m_PublishedCV;
+    std::vector<MobilePlacement> m_PendingPlacements;
+    bool                         m_PendingExpandInstances = false;
+    Uint64                       m_PendingLayoutVersion   = 0;
+    double                       m_RequestedTime          = 0;
+    Uint64                       m_NumKicks               = 0;
+    Uint64                       m_NumPublishedKicks      = 0;
+    bool                         m_ResetPending           = false;
+    double                       m_ResetTime              = 0;
+    float                        m_ResetAngle             = 0;
+    bool                         m_Stop                   = false;
+
+    // Owned by the simulation thread
+    std::vector<MobilePlacement> m_Placements;
+    bool                         m_ExpandInstances = false;
+    Uint64                       m_LayoutVersion   = 0;
+    Uint64                       m_NumHandledKicks = 0;
+    Uint64                       m_Version         = 0;
+    Uint64                       m_NumSteps        = 0;
+    double                       m_SimTime         = 0;
+    bool                         m_ClockStarted    = false;
+    // Angles of the last two simulation steps, at m_SimTime - StepDuration and m_SimTime
+    float                        m_PrevAngle       = 0;
+    float                        m_Angle           = 0;
+
+    std::thread m_Thread;
+};
+
+} // namespace Diligent
@@ -0,0 +1,163 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include <cmath>
+
+#include "MobileTemplate.hpp"
+#include "CounterRNG.hpp"
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+namespace
+{
+
+// Figuras en el Mobil
+const MobilePart MobileParts[] =
+    {
+        // clang-format off
+        {float3{0.7f,  0.7f,  0.7f }, float3{ 0, 4,  0}}, // Center lv 1
+        {float3{0.6f,  0.6f,  0.6f }, float3{ 6, 6,  0}}, // Right lv 1
+        {float3{0.6f,  0.6f,  0.6f }, float3{-6, 6,  0}}, // Left lv 1
+        {float3{0.6f,  0.6f,  0.6f }, float3{ 0, 6,  6}}, // Front lv 1
+        {float3{0.6f,  0.6f,  0.6f }, float3{ 0, 6, -6}}, // Back lv 1
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 6, 3,  0}}, // Right lv 2
+        {float3{0.5f,  0.5f,  0.5f }, float3{-6, 3,  0}}, // Left lv 2
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 0, 3,  6}}, // Front lv 2
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 0, 3, -6}}, // Back lv 2
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 6, 0,  0}}, // Right lv 3
+        {float3{0.5f,  0.5f,  0.5f }, float3{-6, 0,  0}}, // Left lv 3
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 0, 0,  6}}, // Front lv 3
+        {float3{0.5f,  0.5f,  0.5f }, float3{ 0, 0, -6}}, // Back lv 3
+
+        // Tubos
+        {float3{6.f,   0.08f, 0.08f}, float3{ 0, 8,  0}}, // Center lv 1
+        {float3{0.08f, 0.08f, 6.f  }, float3{ 0, 8,  0}}, // Center lv 1
+
+        // Palos para abajos
+        {float3{0.08f, 2.f,   0.08f}, float3{ 0, 6,  0}},
+        {float3{0.08f, 4.f,   0.08f}, float3{ 6, 4,  0}},
+        {float3{0.08f, 4.f,   0.08f}, float3{ 0, 4,  6}},
+        {float3{0.08f, 4.f,   0.08f}, float3{-6, 4,  0}},
+        {float3{0.08f, 4.f,   0.08f}, float3{ 0, 4, -6}},
+        // clang-format on
+};
+static_assert(_countof(MobileParts) == MobileTemplate::NumParts, "Unexpected number of mobile parts");
+
+// Random stream of the placements. Streams 0 and 1 are used by the procedural grid.
+constexpr Uint32 PlacementRandomStream = 2;
+
+} // namespace
+
+const MobilePart& MobileTemplate::GetPart(Uint32 Part)
+{
+    VERIFY_EXPR(Part < NumParts);
+    return MobileParts[Part];
+}
+
+float4x4 MobileTemplate::GetPartTransform(Uint32 Part)
+{
+    const auto& P = GetPart(Part);
+    return float4x4::Scale(P.Scale.x, P.Scale.y, P.Scale.z) * float4x4::Translation(P.Offset);
+}
+
+float4x4 MobileTemplate::GetMobileTransform(const MobilePlacement& Placement, float Angle)
+{
+    // RotationY(Angle + Phase) * Translation(Position)
+    const float s = std::sin(Angle + Placement.Phase);
+    const float c = std::cos(Angle + Placement.Phase);
+    // clang-format off
+    return float4x4
+    {
+        c, 0, -s, 0,
+        0, 1,  0, 0,
+        s, 0,  c, 0,
+        Placement.Position.x, Placement.Position.y, Placement.Position.z, 1
+    };
+    // clang-format on
+}
+
+Uint32 MobileTemplate::GetLayoutSide(Uint32 NumMobiles)
+{
+    // Side of the smallest square that fits all mobiles
+    Uint32 Side = static_cast<Uint32>(std::sqrt(static_cast<double>(NumMobiles)));
+    while (Uint64{Side} * Side < NumMobiles)
+        ++Side;
+    return Side;
+}
+
+void MobileTemplate::GeneratePlacements(Uint32 NumMobiles, float Spacing, Uint64 Seed, Uint64 Begin, Uint64 End, MobilePlacement* pDst)
+{
+    if (NumMobiles == 0 || Begin >= End)
+        return;
+
+    const Uint32 Side   = GetLayoutSide(NumMobiles);
+    const float  Origin = -0.5f * static_cast<float>(Side - 1) * Spacing;
+
+    for (Uint64 MobileId = Begin; MobileId < End; ++MobileId)
+    {
+        const auto Rnd = Philox4x32::Generate(MobileId, PlacementRandomStream, Seed);
+
+        auto& Placement      = pDst[MobileId - Begin];
+        Placement.Position.x = Origin + static_cast<float>(MobileId % Side) * Spacing;
+        Placement.Position.y = 0;
+        Placement.Position.z = Origin + static_cast<float>(MobileId / Side) * Spacing;
+        Placement.Phase      = UniformFloat(Rnd.v[0], -PI_F, +PI_F);
+    }
+}
+
+void MobileTemplate::ExpandInstances(const MobilePlacement* pPlacements, float Angle, Uint64 Begin, Uint64 End, float4x4* pDst)
+{
+    for (Uint64 MobileId = Begin; MobileId < End; ++MobileId)
+    {
+        const float4x4 M = GetMobileTransform(pPlacements[MobileId], Angle);
+
+        // Part transforms only contain scale and offset, so Scale * Translation(Offset) * M is computed
+        // without a full matrix product: the first three rows of M are scaled, and the last row is
+        // the offset transformed by M.
+        float4x4* pParts = pDst + (MobileId - Begin) * NumParts;
+        for (Uint32 i = 0; i < NumParts; ++i)
+        {
+            const auto& Part = MobileParts[i];
+            // clang-format off
+            pParts[i] = float4x4
+            {
+                Part.Scale.x * M._11, Part.Scale.x * M._12, Part.Scale.x * M._13, 0,
+                Part.Scale.y * M._21, Part.Scale.y * M._22, Part.Scale.y * M._23, 0,
+                Part.Scale.z * M._31, Part.Scale.z * M._32, Part.Scale.z * M._33, 0,
+                Part.Offset.x * M._11 + Part.Offset.y * M._21 + Part.Offset.z * M._31 + M._41,
+                Part.Offset.x * M._12 + Part.Offset.y * M._22 + Part.Offset.z * M._32 + M._42,
+                Part.Offset.x * M._13 + Part.Offset.y * M._23 + Part.Offset.z * M._33 + M._43,
+                1
+            };
+            // clang-format on
+        }
+    }
+}
+
+} // namespace Diligent
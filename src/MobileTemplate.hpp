@@ -0,0 +1,75 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include "BasicMath.hpp"
+
+namespace Diligent
+{
+
+// Scale and offset of one part (a cube or a rod) in the mobile space
+struct MobilePart
+{
+    float3 Scale;
+    float3 Offset;
+};
+
+// Position and animation phase of one mobile
+struct MobilePlacement
+{
+    float3 Position;
+    float  Phase = 0;
+};
+
+// The mobile of the sample (cubes hanging from rods) used as a template: the part-local
+// transforms are shared by all mobiles, and every mobile only adds its placement.
+struct MobileTemplate
+{
+    static constexpr Uint32 NumParts = 20;
+
+    static const MobilePart& GetPart(Uint32 Part);
+
+    // Returns the part-local transform (scale and offset) of the given part
+    static float4x4 GetPartTransform(Uint32 Part);
+
+    // Returns the transform that places the mobile in the scene, rotated by Angle + Phase around its vertical axis
+    static float4x4 GetMobileTransform(const MobilePlacement& Placement, float Angle);
+
+    // Returns the number of mobiles along each side of the square layout
+    static Uint32 GetLayoutSide(Uint32 NumMobiles);
+
+    // Writes placements [Begin, End) of NumMobiles mobiles to pDst[0 .. End - Begin).
+    // Mobiles are laid out on a square in the XZ plane centered at the origin, Spacing units
+    // apart from each other, and every mobile has a random phase.
+    static void GeneratePlacements(Uint32 NumMobiles, float Spacing, Uint64 Seed, Uint64 Begin, Uint64 End, MobilePlacement* pDst);
+
+    // Expands mobiles [Begin, End) into NumParts instances each and writes them to pDst[0 .. (End - Begin) * NumParts)
+    static void ExpandInstances(const MobilePlacement* pPlacements, float Angle, Uint64 Begin, Uint64 End, float4x4* pDst);
+};
+
+} // namespace Diligent
@@ -0,0 +1,97 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include <cmath>
+
+#include "ProceduralGrid.hpp"
+#include "CounterRNG.hpp"
+
+namespace Diligent
+{
+
+void ProceduralGrid::GenerateInstances(Uint32 GridSize, Uint64 Seed, float Extent, Uint64 Begin, Uint64 End, float4x4* pDst)
+{
+    if (GridSize == 0 || Begin >= End)
+        return;
+
+    const float fGridSize = static_cast<float>(GridSize);
+    const float BaseScale = 0.6f / fGridSize * Extent;
+    const float CellSize  = 2.f / fGridSize * Extent;
+
+    // Cell coordinates are advanced incrementally instead of being computed with two divisions per instance.
+    // The order is the same as in the original x, y, z loops: z changes fastest.
+    Uint32 x = static_cast<Uint32>(Begin / (Uint64{GridSize} * GridSize));
+    Uint32 y = static_cast<Uint32>((Begin / GridSize) % GridSize);
+    Uint32 z = static_cast<Uint32>(Begin % GridSize);
+
+    for (Uint64 InstId = Begin; InstId < End; ++InstId)
+    {
+        // Seven random values per instance come from two blocks
+        const auto Rnd0 = Philox4x32::Generate(InstId, 0, Seed);
+        const auto Rnd1 = Philox4x32::Generate(InstId, 1, Seed);
+
+        // Add random offset from central position in the grid
+        const float xOffset = (static_cast<float>(x) + 0.5f + UniformFloat(Rnd0.v[0], -0.15f, +0.15f)) * CellSize - Extent;
+        const float yOffset = (static_cast<float>(y) + 0.5f + UniformFloat(Rnd0.v[1], -0.15f, +0.15f)) * CellSize - Extent;
+        const float zOffset = (static_cast<float>(z) + 0.5f + UniformFloat(Rnd0.v[2], -0.15f, +0.15f)) * CellSize - Extent;
+        // Random scale
+        const float Scale = BaseScale * UniformFloat(Rnd0.v[3], 0.3f, 1.0f);
+
+        // Random rotation RotationX(a) * RotationY(b) * RotationZ(c), expanded analytically
+        // to avoid building and multiplying three 4x4 matrices per instance
+        const float a  = UniformFloat(Rnd1.v[0], -PI_F, +PI_F);
+        const float b  = UniformFloat(Rnd1.v[1], -PI_F, +PI_F);
+        const float c  = UniformFloat(Rnd1.v[2], -PI_F, +PI_F);
+        const float sa = std::sin(a), ca = std::cos(a);
+        const float sb = std::sin(b), cb = std::cos(b);
+        const float sc = std::sin(c), cc = std::cos(c);
+
+        // Combine rotation, scale and translation: the scale multiplies the rotation rows,
+        // and the translation is the last row.
+        // clang-format off
+        pDst[InstId - Begin] = float4x4
+        {
+            Scale * (cb * cc),                Scale * (cb * sc),                Scale * (-sb),     0,
+            Scale * (sa * sb * cc - ca * sc), Scale * (sa * sb * sc + ca * cc), Scale * (sa * cb), 0,
+            Scale * (ca * sb * cc + sa * sc), Scale * (ca * sb * sc - sa * cc), Scale * (ca * cb), 0,
+            xOffset,                          yOffset,                          zOffset,           1
+        };
+        // clang-format on
+
+        if (++z == GridSize)
+        {
+            z = 0;
+            if (++y == GridSize)
+            {
+                y = 0;
+                ++x;
+            }
+        }
+    }
+}
+
+} // namespace Diligent
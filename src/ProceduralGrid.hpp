@@ -0,0 +1,52 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include "BasicMath.hpp"
+
+namespace Diligent
+{
+
+// Randomized GridSize^3 grid of cubes from the original instancing tutorial: every cube is
+// placed near the center of its grid cell with a random offset, scale and rotation.
+// Random values are produced by a counter-based generator keyed on the instance index,
+// so any range of instances can be generated independently of the others.
+struct ProceduralGrid
+{
+    static constexpr Uint64 DefaultSeed = 0;
+
+    static Uint64 GetNumInstances(Uint32 GridSize)
+    {
+        return Uint64{GridSize} * GridSize * GridSize;
+    }
+
+    // Writes instances [Begin, End) to pDst[0 .. End - Begin). The grid spans [-Extent, +Extent] along every axis.
+    static void GenerateInstances(Uint32 GridSize, Uint64 Seed, float Extent, Uint64 Begin, Uint64 End, float4x4* pDst);
+};
+
+} // namespace Diligent
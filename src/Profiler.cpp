@@ -0,0 +1,96 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "Profiler.hpp"
+
+#include <atomic>
+
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+namespace
+{
+
+std::atomic<IProfilerSink*> g_Sinks[Profiler::MaxSinks] = {};
+
+template <typename HandlerType>
+void ForEachSink(HandlerType Handler)
+{
+    for (auto& Sink : g_Sinks)
+    {
+        if (auto* pSink = Sink.load(std::memory_order_acquire))
+            Handler(*pSink);
+    }
+}
+
+} // namespace
+
+bool Profiler::AddSink(IProfilerSink* pSink)
+{
+    VERIFY_EXPR(pSink != nullptr);
+    for (auto& Sink : g_Sinks)
+    {
+        IProfilerSink* pExpected = nullptr;
+        if (Sink.compare_exchange_strong(pExpected, pSink))
+            return true;
+    }
+    LOG_ERROR_MESSAGE("Too many profiler sinks. At most ", MaxSinks, " sinks are supported.");
+    return false;
+}
+
+void Profiler::RemoveSink(IProfilerSink* pSink)
+{
+    for (auto& Sink : g_Sinks)
+    {
+        IProfilerSink* pExpected = pSink;
+        Sink.compare_exchange_strong(pExpected, nullptr);
+    }
+}
+
+void Profiler::BeginZone(const Char* Name)
+{
+    ForEachSink([Name](IProfilerSink& Sink) { Sink.BeginZone(Name); });
+}
+
+void Profiler::EndZone(const Char* Name)
+{
+    ForEachSink([Name](IProfilerSink& Sink) { Sink.EndZone(Name); });
+}
+
+void Profiler::Counter(const Char* Name, double Value)
+{
+    ForEachSink([Name, Value](IProfilerSink& Sink) { Sink.Counter(Name, Value); });
+}
+
+void Profiler::FrameMark()
+{
+    ForEachSink([](IProfilerSink& Sink) { Sink.FrameMark(); });
+}
+
+} // namespace Diligent
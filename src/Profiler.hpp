@@ -0,0 +1,114 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include "BasicTypes.h"
+
+// Profiler markers compile to nothing when T4_PROFILER_ENABLED is 0.
+#ifndef T4_PROFILER_ENABLED
+#    define T4_PROFILER_ENABLED 1
+#endif
+
+namespace Diligent
+{
+
+// Receives instrumentation events. Implement this interface to route the markers
+// to an external profiler and register the implementation with Profiler::AddSink().
+// Methods may be called from any thread. Names are string literals.
+class IProfilerSink
+{
+public:
+    virtual ~IProfilerSink() {}
+
+    virtual void BeginZone(const Char* Name)             = 0;
+    virtual void EndZone(const Char* Name)               = 0;
+    virtual void Counter(const Char* Name, double Value) = 0;
+    virtual void FrameMark()                             = 0;
+};
+
+// Dispatches instrumentation events to the registered sinks.
+// Sinks must be registered before other threads start emitting events.
+class Profiler
+{
+public:
+    static constexpr Uint32 MaxSinks = 4;
+
+    static bool AddSink(IProfilerSink* pSink);
+    static void RemoveSink(IProfilerSink* pSink);
+
+    static void BeginZone(const Char* Name);
+    static void EndZone(const Char* Name);
+    static void Counter(const Char* Name, double Value);
+    static void FrameMark();
+};
+
+class ProfilerZone
+{
+public:
+    explicit ProfilerZone(const Char* Name) :
+        m_Name{Name}
+    {
+        Profiler::BeginZone(m_Name);
+    }
+
+    ~ProfilerZone()
+    {
+        Profiler::EndZone(m_Name);
+    }
+
+    // clang-format off
+    ProfilerZone           (const ProfilerZone&) = delete;
+    ProfilerZone& operator=(const ProfilerZone&) = delete;
+    // clang-format on
+
+private:
+    const Char* m_Name;
+};
+
+} // namespace Diligent
+
+#if T4_PROFILER_ENABLED
+
+#    define T4_PROFILER_CONCAT_IMPL(a, b) a##b
+#    define T4_PROFILER_CONCAT(a, b)      T4_PROFILER_CONCAT_IMPL(a, b)
+
+#    define T4_PROFILE_ZONE(Name)           ::Diligent::ProfilerZone T4_PROFILER_CONCAT(ProfilerZone_, __LINE__){Name}
+#    define T4_PROFILE_ZONE_BEGIN(Name)     ::Diligent::Profiler::BeginZone(Name)
+#    define T4_PROFILE_ZONE_END(Name)       ::Diligent::Profiler::EndZone(Name)
+#    define T4_PROFILE_COUNTER(Name, Value) ::Diligent::Profiler::Counter(Name, static_cast<double>(Value))
+#    define T4_PROFILE_FRAME_MARK()         ::Diligent::Profiler::FrameMark()
+
+#else
+
+#    define T4_PROFILE_ZONE(Name)
+#    define T4_PROFILE_ZONE_BEGIN(Name)
+#    define T4_PROFILE_ZONE_END(Name)
+#    define T4_PROFILE_COUNTER(Name, Value)
+#    define T4_PROFILE_FRAME_MARK()
+
+#endif
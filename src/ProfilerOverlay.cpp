@@ -0,0 +1,107 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "ProfilerOverlay.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+#include "DebugUtilities.hpp"
+#include "imgui.h"
+
+namespace Diligent
+{
+
+namespace
+{
+
+using ZoneClock = std::chrono::steady_clock;
+
+// Zones are properly nested on every thread, so open zones are tracked with a per-thread stack
+thread_local std::vector<std::pair<const Char*, ZoneClock::time_point>> t_OpenZones;
+
+} // namespace
+
+void ProfilerOverlay::BeginZone(const Char* Name)
+{
+    t_OpenZones.emplace_back(Name, ZoneClock::now());
+}
+
+void ProfilerOverlay::EndZone(const Char* Name)
+{
+    if (t_OpenZones.empty())
+        return;
+
+    const auto Zone = t_OpenZones.back();
+    t_OpenZones.pop_back();
+    VERIFY(std::strcmp(Zone.first, Name) == 0, "Zone '", Name, "' ends while zone '", Zone.first, "' is open");
+    (void)Name;
+
+    const double DurationMs = std::chrono::duration<double, std::milli>(ZoneClock::now() - Zone.second).count();
+
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    m_Zones[Zone.first].FrameTotalMs += DurationMs;
+}
+
+void ProfilerOverlay::Counter(const Char* Name, double Value)
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    m_Counters[Name] = Value;
+}
+
+void ProfilerOverlay::FrameMark()
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    for (auto& It : m_Zones)
+    {
+        auto& Stats = It.second;
+        // Exponential moving average smooths out the noise while still reacting to changes quickly
+        Stats.AverageMs    = Stats.AverageMs + (Stats.FrameTotalMs - Stats.AverageMs) * 0.05;
+        Stats.PeakMs       = std::max(Stats.PeakMs * 0.99, Stats.FrameTotalMs);
+        Stats.FrameTotalMs = 0;
+    }
+}
+
+double ProfilerOverlay::GetCounter(const Char* Name) const
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+
+    auto It = m_Counters.find(Name);
+    return It != m_Counters.end() ? It->second : 0;
+}
+
+void ProfilerOverlay::Draw()
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    for (const auto& It : m_Zones)
+        ImGui::Text("%-24s %7.3f ms (peak %7.3f)", It.first, It.second.AverageMs, It.second.PeakMs);
+    for (const auto& It : m_Counters)
+        ImGui::Text("%-24s %g", It.first, It.second);
+}
+
+} // namespace Diligent
@@ -0,0 +1,224 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#include "TraceRecorder.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+#include "DebugUtilities.hpp"
+
+namespace Diligent
+{
+
+namespace
+{
+
+// Small sequential thread index that is much easier to read in the timeline than std::thread::id.
+Uint32 GetCurrentThreadIndex()
+{
+    static std::atomic<Uint32> NextThreadIndex{1};
+    thread_local const Uint32  ThreadIndex = NextThreadIndex.fetch_add(1);
+    return ThreadIndex;
+}
+
+// Writes the string as a JSON string literal. Quotes, backslashes and control
+// characters would otherwise make the trace file unreadable.
+void WriteJsonString(std::ostream& Stream, const Char* Str)
+{
+    Stream << '"';
+    for (const Char* c = Str != nullptr ? Str : ""; *c != '\0'; ++c)
+    {
+        switch (*c)
+        {
+            case '"': Stream << "\\\""; break;
+            case '\\': Stream << "\\\\"; break;
+            case '\n': Stream << "\\n"; break;
+            case '\r': Stream << "\\r"; break;
+            case '\t': Stream << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(*c) < 0x20)
+                {
+                    char Code[8];
+                    std::snprintf(Code, sizeof(Code), "\\u%04x", static_cast<unsigned int>(*c));
+                    Stream << Code;
+                }
+                else
+                {
+                    Stream << *c;
+                }
+        }
+    }
+    Stream << '"';
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder(size_t Capacity) :
+    m_StartTime{std::chrono::steady_clock::now()},
+    m_Events(std::max(Capacity, size_t{1}))
+{
+}
+
+void TraceRecorder::AddEvent(const Char* Name, char Phase, double Value)
+{
+    if (!IsEnabled())
+        return;
+
+    Event Evt;
+    Evt.Name     = Name;
+    Evt.TimeNs   = static_cast<Uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_StartTime).count());
+    Evt.ThreadId = GetCurrentThreadIndex();
+    Evt.Phase    = Phase;
+    Evt.Value    = Value;
+
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    m_Events[m_NumRecorded % m_Events.size()] = Evt;
+    ++m_NumRecorded;
+}
+
+void TraceRecorder::BeginEvent(const Char* Name)
+{
+    AddEvent(Name, 'B');
+}
+
+void TraceRecorder::EndEvent(const Char* Name)
+{
+    AddEvent(Name, 'E');
+}
+
+void TraceRecorder::CounterEvent(const Char* Name, double Value)
+{
+    AddEvent(Name, 'C', Value);
+}
+
+void TraceRecorder::InstantEvent(const Char* Name)
+{
+    AddEvent(Name, 'i');
+}
+
+void TraceRecorder::SetThreadName(const Char* Name)
+{
+    const auto ThreadId = GetCurrentThreadIndex();
+
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    m_ThreadNames[ThreadId] = Name != nullptr ? Name : "";
+}
+
+size_t TraceRecorder::GetNumEvents() const
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    return static_cast<size_t>(std::min<Uint64>(m_NumRecorded, m_Events.size()));
+}
+
+void TraceRecorder::Clear()
+{
+    std::lock_guard<std::mutex> Lock{m_Mtx};
+    m_NumRecorded = 0;
+}
+
+bool TraceRecorder::WriteChromeTrace(const Char* FilePath) const
+{
+    std::vector<Event>                      Events;
+    std::unordered_map<Uint32, std::string> ThreadNames;
+    {
+        // Copy the events out so that recording is not blocked while the file is written
+        std::lock_guard<std::mutex> Lock{m_Mtx};
+
+        const auto NumEvents = std::min<Uint64>(m_NumRecorded, m_Events.size());
+        Events.reserve(static_cast<size_t>(NumEvents));
+        for (Uint64 i = m_NumRecorded - NumEvents; i < m_NumRecorded; ++i)
+            Events.push_back(m_Events[i % m_Events.size()]);
+        ThreadNames = m_ThreadNames;
+    }
+
+    std::ofstream Stream{FilePath};
+    if (!Stream)
+    {
+        LOG_ERROR_MESSAGE("Failed to open trace file '", FilePath, "' for writing");
+        return false;
+    }
+
+    Stream << "{\"traceEvents\":[\n";
+
+    bool IsFirst = true;
+    for (const auto& Name : ThreadNames)
+    {
+        Stream << (IsFirst ? "" : ",\n")
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << Name.first
+               << ",\"args\":{\"name\":";
+        WriteJsonString(Stream, Name.second.c_str());
+        Stream << "}}";
+        IsFirst = false;
+    }
+
+    // Per-thread nesting depth is used to drop end events whose begin events were
+    // overwritten when the ring buffer wrapped around.
+    std::unordered_map<Uint32, int> Depth;
+    Stream.setf(std::ios::fixed);
+    Stream.precision(3);
+    for (const auto& Evt : Events)
+    {
+        auto& ThreadDepth = Depth[Evt.ThreadId];
+        if (Evt.Phase == 'E')
+        {
+            if (ThreadDepth == 0)
+                continue;
+            --ThreadDepth;
+        }
+        else if (Evt.Phase == 'B')
+        {
+            ++ThreadDepth;
+        }
+
+        Stream << (IsFirst ? "" : ",\n") << "{\"name\":";
+        WriteJsonString(Stream, Evt.Name);
+        Stream << ",\"ph\":\"" << Evt.Phase
+               << "\",\"ts\":" << static_cast<double>(Evt.TimeNs) / 1000.0
+               << ",\"pid\":1,\"tid\":" << Evt.ThreadId;
+        if (Evt.Phase == 'C')
+            Stream << ",\"args\":{\"value\":" << Evt.Value << "}";
+        else if (Evt.Phase == 'i')
+            Stream << ",\"s\":\"p\"";
+        Stream << "}";
+        IsFirst = false;
+    }
+
+    Stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    if (!Stream)
+    {
+        LOG_ERROR_MESSAGE("Failed to write trace file '", FilePath, "'");
+        return false;
+    }
+
+    LOG_INFO_MESSAGE("Saved ", Events.size(), " trace events to '", FilePath, "'");
+    return true;
+}
+
+} // namespace Diligent
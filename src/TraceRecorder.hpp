@@ -0,0 +1,128 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+#include "BasicTypes.h"
+#include "Profiler.hpp"
+
+namespace Diligent
+{
+
+// Records begin/end events into a bounded in-memory ring buffer. When the buffer is full,
+// the oldest events are overwritten. The contents can be dumped at any time in the
+// Chrome trace event format that can be opened in chrome://tracing or ui.perfetto.dev.
+// The recorder can be registered as a profiler sink to capture the profiler markers.
+class TraceRecorder final : public IProfilerSink
+{
+public:
+    static constexpr size_t DefaultCapacity = 1u << 16u;
+
+    explicit TraceRecorder(size_t Capacity = DefaultCapacity);
+
+    // Event names are not copied and must outlive the recorder (string literals are fine).
+    void BeginEvent(const Char* Name);
+    void EndEvent(const Char* Name);
+    void CounterEvent(const Char* Name, double Value);
+    void InstantEvent(const Char* Name);
+
+    virtual void BeginZone(const Char* Name) override final { BeginEvent(Name); }
+    virtual void EndZone(const Char* Name) override final { EndEvent(Name); }
+    virtual void Counter(const Char* Name, double Value) override final { CounterEvent(Name, Value); }
+    virtual void FrameMark() override final { InstantEvent("Frame"); }
+
+    // Assigns a name to the calling thread that is shown in the timeline.
+    void SetThreadName(const Char* Name);
+
+    // Writes recorded events to a JSON file. End events whose begin event has
+    // already been overwritten are dropped.
+    bool WriteChromeTrace(const Char* FilePath) const;
+
+    void Clear();
+
+    void SetEnabled(bool Enabled) { m_Enabled.store(Enabled, std::memory_order_relaxed); }
+    bool IsEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+    size_t GetNumEvents() const;
+    size_t GetCapacity() const { return m_Events.size(); }
+
+private:
+    struct Event
+    {
+        const Char* Name     = nullptr;
+        Uint64      TimeNs   = 0;
+        Uint32      ThreadId = 0;
+        char        Phase    = 'B';
+        double      Value    = 0;
+    };
+
+    void AddEvent(const Char* Name, char Phase, double Value = 0);
+
+    const std::chrono::steady_clock::time_point m_StartTime;
+
+    mutable std::mutex                      m_Mtx;
+    std::vector<Event>                      m_Events;
+    Uint64                                  m_NumRecorded = 0;
+    std::unordered_map<Uint32, std::string> m_ThreadNames;
+
+    std::atomic_bool m_Enabled{true};
+};
+
+// Emits a begin event on construction and the matching end event on destruction.
+class ScopedTraceEvent
+{
+public:
+    ScopedTraceEvent(TraceRecorder& Recorder, const Char* Name) :
+        m_Recorder{Recorder},
+        m_Name{Name}
+    {
+        m_Recorder.BeginEvent(m_Name);
+    }
+
+    ~ScopedTraceEvent()
+    {
+        m_Recorder.EndEvent(m_Name);
+    }
+
+    // clang-format off
+    ScopedTraceEvent           (const ScopedTraceEvent&) = delete;
+    ScopedTraceEvent& operator=(const ScopedTraceEvent&) = delete;
+    // clang-format on
+
+private:
+    TraceRecorder& m_Recorder;
+    const Char*    m_Name;
+};
+
+} // namespace Diligent
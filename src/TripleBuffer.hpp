@@ -0,0 +1,88 @@
+/*
+ *  Copyright 2019-2024 Diligent Graphics LLC
+ *  Copyright 2015-2019 Egor Yusov
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  In no event and under no legal theory, whether in tort (including negligence),
+ *  contract, or otherwise, unless required by applicable law (such as deliberate
+ *  and grossly negligent acts) or agreed to in writing, shall any Contributor be
+ *  liable for any damages, including any direct, indirect, special, incidental,
+ *  or consequential damages of any character arising as a result of this License or
+ *  out of the use or inability to use the software (including but not limited to damages
+ *  for loss of goodwill, work stoppage, computer failure or malfunction, or any and
+ *  all other commercial damages or losses), even if such Contributor has been advised
+ *  of the possibility of such damages.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "BasicTypes.h"
+
+namespace Diligent
+{
+
+// Lock-free triple buffer for a single producer and a single consumer. The producer
+// always has a buffer to write to, and the consumer always reads the most recently
+// published one, so neither side ever waits for the other. Intermediate values that
+// the consumer did not pick up in time are overwritten.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    // clang-format off
+    TripleBuffer           (const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+    // clang-format on
+
+    // Producer: returns the buffer that is owned by the producer until the next Publish()
+    T& GetWriteBuffer() { return m_Buffers[m_WriteIdx]; }
+
+    // Producer: makes the write buffer available to the consumer and takes over the buffer
+    // that the consumer has not picked up yet or has released
+    void Publish()
+    {
+        m_WriteIdx = m_SharedIdx.exchange(m_WriteIdx | NewDataFlag, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Consumer: switches to the most recently published buffer. Returns false if nothing
+    // has been published since the last call, in which case the read buffer stays the same.
+    bool Acquire()
+    {
+        if ((m_SharedIdx.load(std::memory_order_relaxed) & NewDataFlag) == 0)
+            return false;
+        m_ReadIdx = m_SharedIdx.exchange(m_ReadIdx, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    // Consumer: returns the buffer that is owned by the consumer until the next Acquire()
+    const T& GetReadBuffer() const { return m_Buffers[m_ReadIdx]; }
+
+private:
+    static constexpr Uint32 IndexMask   = 0x3;
+    static constexpr Uint32 NewDataFlag = 0x4;
+
+    T m_Buffers[3];
+
+    // Every index is owned by exactly one side at a time: the producer, the consumer,
+    // or the shared slot that is exchanged between them
+    Uint32              m_WriteIdx = 0;
+    std::atomic<Uint32> m_SharedIdx{1};
+    Uint32              m_ReadIdx = 2;
+};
+
+} // namespace Diligent
@@ -25,24 +25,203 @@
  *  of the possibility of such damages.
  */
 
-#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #include "Tutorial04_Instancing.hpp"
+#include "ProceduralGrid.hpp"
+#include "MobileTemplate.hpp"
 #include "MapHelper.hpp"
 #include "GraphicsUtilities.h"
 #include "TextureUtilities.h"
 #include "ColorConversion.h"
+#include "Timer.hpp"
 #include "../../Common/src/TexturedCube.hpp"
 #include "imgui.h"
 
 namespace Diligent
 {
 
+namespace
+{
+
+// The number of instances generated by one job
+constexpr Uint64 InstanceGenChunkSize = 4096;
+
+// Half-size of the stress test grid. The grid fills the space around the mobile.
+constexpr float GridStressExtent = 10.f;
+
+// Suffixes of the cube pipeline names, indexed by the cube pass
+constexpr const char* CubePassPSOSuffixes[] = {" PSO", " depth pre-pass PSO", " depth-equal PSO"};
+
+// Layouts of the constant buffers declared in cube_constants.fxh
+struct ViewConstants
+{
+    float4x4 ViewProj;
+};
+
+struct FrameConstants
+{
+    float4 MobileAnim; // x - rotation angle of all mobiles
+};
+
+struct StaticConstants
+{
+    float4x4 Rotation;
+};
+
+// Static per-instance attributes of the split instance streams, see cube_inst_split.vsh
+struct StaticInstanceAttribs
+{
+    float3 PartScale;
+    float3 PartOffset;
+    float3 MobilePosition;
+};
+
+// Layout of the constant buffer declared in instance_cull.csh
+struct CullConstants
+{
+    float4x4 ViewProj;
+    float4x4 HiZViewProj;
+    float4   NDCAttribs; // x - MinZ, y - ZtoDepthScale, z - YtoVScale
+    float2   DepthSize;
+    Uint32   HiZMipLevels = 0;
+    Uint32   HiZValid     = 0;
+    Uint32   NumInstances = 0;
+    Uint32   UseOrder     = 0;
+    Uint32   Padding[2]   = {};
+};
+
+// Arguments of the indirect draw of the culled instances before the culling pass adds the instances
+constexpr Uint32 CulledDrawArgs[] = {36, 0, 0, 0, 0};
+
+// Distance between neighboring mobiles in the many-mobiles scene
+constexpr float  MobileSpacing    = 16.f;
+constexpr Uint64 MobileLayoutSeed = 0;
+
+} // namespace
+
 SampleBase* CreateSample()
 {
     return new Tutorial04_Instancing();
 }
 
+Tutorial04_Instancing::~Tutorial04_Instancing()
+{
+    // The simulation and worker threads emit profiler zones, so they are joined
+    // before the sinks are removed and destroyed
+    m_Simulation.reset();
+    m_JobSystem.reset();
+    Profiler::RemoveSink(&m_Trace);
+    Profiler::RemoveSink(&m_ProfilerOverlay);
+}
+
+SampleBase::CommandLineStatus Tutorial04_Instancing::ProcessCommandLine(int argc, const char* const* argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string Arg = argv[i];
+        if (Arg == "--trace_file" && i + 1 < argc)
+        {
+            m_TraceFilePath = argv[++i];
+        }
+        else if (Arg == "--record" && i + 1 < argc)
+        {
+            m_RecordFilePath = argv[++i];
+            m_RecordOnStart  = true;
+        }
+        else if (Arg == "--replay" && i + 1 < argc)
+        {
+            m_ReplayFilePath = argv[++i];
+        }
+        else if (Arg == "--asset_dir" && i + 1 < argc)
+        {
+            m_AssetDir = argv[++i];
+        }
+        else if (Arg == "--worker_threads" && i + 1 < argc)
+        {
+            m_NumWorkerThreads = static_cast<Uint32>(std::atoi(argv[++i]));
+        }
+        else if (Arg == "--scene" && i + 1 < argc)
+        {
+            m_SceneMode = std::clamp(std::atoi(argv[++i]), 0, SCENE_MODE_COUNT - 1);
+        }
+        else if (Arg == "--num_mobiles" && i + 1 < argc)
+        {
+            m_NumMobiles = std::clamp(std::atoi(argv[++i]), 1, MaxNumMobiles);
+        }
+        else if (Arg == "--mobile_instancing" && i + 1 < argc)
+        {
+            m_MobileInstancing = std::clamp(std::atoi(argv[++i]), 0, MOBILE_INSTANCING_COUNT - 1);
+        }
+        else if (Arg == "--vertex_pulling")
+        {
+            m_VertexPulling = true;
+        }
+        else if (Arg == "--depth_sort")
+        {
+            m_DepthSort = true;
+        }
+        else if (Arg == "--depth_prepass")
+        {
+            m_DepthPrepass = true;
+        }
+        else if (Arg == "--occlusion_culling")
+        {
+            m_OcclusionCulling = true;
+        }
+        else if (Arg == "--idle")
+        {
+            m_IdleMode = true;
+        }
+        else if (Arg == "--draw_validation" && i + 1 < argc)
+        {
+            m_DrawValidation = std::clamp(std::atoi(argv[++i]), 0, DRAW_VALIDATION_COUNT - 1);
+        }
+        else if (Arg == "--frames_in_flight" && i + 1 < argc)
+        {
+            m_NumFramesInFlight = static_cast<Uint32>(std::clamp(std::atoi(argv[++i]), 1, static_cast<int>(MaxFramesInFlight)));
+        }
+        else if (Arg == "--grid_size" && i + 1 < argc)
+        {
+            m_GridSize = std::clamp(std::atoi(argv[++i]), 1, MaxGridSize);
+        }
+        else if (Arg == "--camera_mode" && i + 1 < argc)
+        {
+            m_CameraMode = std::clamp(std::atoi(argv[++i]), 0, 4);
+        }
+        else if (Arg == "--anim_angle" && i + 1 < argc)
+        {
+            // Freezes the mobile at the given angle, which makes the output deterministic
+            m_MobileAngle   = static_cast<float>(std::atof(argv[++i]));
+            m_AnimateMobile = false;
+        }
+        else if (Arg == "--benchmark" && i + 1 < argc)
+        {
+            m_BenchSettings.NumFrames = static_cast<Uint32>(std::atoi(argv[++i]));
+            m_RunBenchmark            = true;
+        }
+        else if (Arg == "--bench_warmup" && i + 1 < argc)
+        {
+            m_BenchSettings.NumWarmupFrames = static_cast<Uint32>(std::atoi(argv[++i]));
+        }
+        else if (Arg == "--bench_baseline" && i + 1 < argc)
+        {
+            m_BenchSettings.BaselineFilePath = argv[++i];
+        }
+        else if (Arg == "--bench_output" && i + 1 < argc)
+        {
+            m_BenchSettings.OutputFilePath = argv[++i];
+        }
+        else if (Arg == "--bench_tolerance" && i + 1 < argc)
+        {
+            m_BenchSettings.DefaultTolerance = std::atof(argv[++i]);
+        }
+    }
+    return CommandLineStatus::OK;
+}
+
 void Tutorial04_Instancing::CreatePipelineState()
 {
     // clang-format off
@@ -71,7 +250,7 @@ void Tutorial04_Instancing::CreatePipelineState()
 
     // Create a shader source stream factory to load shaders from files.
     RefCntAutoPtr<IShaderSourceInputStreamFactory> pShaderSourceFactory;
-    m_pEngineFactory->CreateDefaultShaderSourceStreamFactory(nullptr, &pShaderSourceFactory);
+    m_pEngineFactory->CreateDefaultShaderSourceStreamFactory(m_AssetDir.empty() ? nullptr : m_AssetDir.c_str(), &pShaderSourceFactory);
 
     TexturedCube::CreatePSOInfo CubePsoCI;
     CubePsoCI.pDevice                = m_pDevice;
@@ -85,212 +264,1925 @@ void Tutorial04_Instancing::CreatePipelineState()
 
     m_pPSO = TexturedCube::CreatePipelineState(CubePsoCI, m_ConvertPSOutputToGamma);
 
-    // Create dynamic uniform buffer that will store our transformation matrix
-    // Dynamic buffers can be frequently updated by the CPU
-    CreateUniformBuffer(m_pDevice, sizeof(float4x4) * 2, "VS constants CB", &m_VSConstants);
+    // Create uniform buffers that will store our transformation matrices. They are only
+    // written when their contents change, so they use default usage instead of dynamic.
+    CreateUniformBuffer(m_pDevice, sizeof(ViewConstants), "View constants CB", &m_ViewConstants, USAGE_DEFAULT, BIND_UNIFORM_BUFFER, CPU_ACCESS_NONE);
+    CreateUniformBuffer(m_pDevice, sizeof(FrameConstants), "Frame constants CB", &m_FrameConstants, USAGE_DEFAULT, BIND_UNIFORM_BUFFER, CPU_ACCESS_NONE);
+    if (UseGlobalRotation)
+        CreateUniformBuffer(m_pDevice, sizeof(StaticConstants), "Static constants CB", &m_StaticConstants, USAGE_DEFAULT, BIND_UNIFORM_BUFFER, CPU_ACCESS_NONE);
 
-    // Since we did not explicitly specify the type for 'Constants' variable, default
+    // Since we did not explicitly specify the types for the constant buffer variables, default
     // type (SHADER_RESOURCE_VARIABLE_TYPE_STATIC) will be used. Static variables
     // never change and are bound directly to the pipeline state object.
-    m_pPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "Constants")->Set(m_VSConstants);
+    BindConstantBuffers(m_pPSO);
+
+    // Since we are using mutable variable, we must create a shader resource binding object
+    // http://diligentgraphics.com/2016/03/23/resource-binding-model-in-diligent-engine-2-0/
+    m_pPSO->CreateShaderResourceBinding(&m_SRB, true);
+
+    CreatePrepassPipelines(CubePsoCI, m_Prepass);
+    m_Prepass.pDepthPSO->CreateShaderResourceBinding(&m_Prepass.pDepthSRB, true);
+
+    // clang-format off
+    // Two-level instancing pipeline: part transforms are read from a constant buffer, and
+    // mobile placements from a vertex buffer whose attribute advances once per mobile.
+    LayoutElement MobileLayoutElems[] =
+    {
+        // Per-vertex data - first buffer slot
+        // Attribute 0 - vertex position
+        LayoutElement{0, 0, 3, VT_FLOAT32, False},
+        // Attribute 1 - texture coordinates
+        LayoutElement{1, 0, 2, VT_FLOAT32, False},
+
+        // Per-mobile data - second buffer slot
+        // Attribute 2 - position and phase
+        LayoutElement{2, 1, 4, VT_FLOAT32, False, INPUT_ELEMENT_FREQUENCY_PER_INSTANCE, MobileTemplate::NumParts}
+    };
+    // clang-format on
+
+    CubePsoCI.VSFilePath             = "cube_inst_mobile.vsh";
+    CubePsoCI.ExtraLayoutElements    = MobileLayoutElems;
+    CubePsoCI.NumExtraLayoutElements = _countof(MobileLayoutElems);
+
+    m_pMobilePSO = TexturedCube::CreatePipelineState(CubePsoCI, m_ConvertPSOutputToGamma);
+
+    // Part transforms never change, so they are stored in an immutable buffer
+    float4x4 PartTransforms[MobileTemplate::NumParts];
+    for (Uint32 i = 0; i < MobileTemplate::NumParts; ++i)
+        PartTransforms[i] = MobileTemplate::GetPartTransform(i);
+
+    BufferDesc CBDesc;
+    CBDesc.Name      = "Mobile template CB";
+    CBDesc.Usage     = USAGE_IMMUTABLE;
+    CBDesc.BindFlags = BIND_UNIFORM_BUFFER;
+    CBDesc.Size      = sizeof(PartTransforms);
+    BufferData CBData;
+    CBData.pData    = PartTransforms;
+    CBData.DataSize = sizeof(PartTransforms);
+    m_pDevice->CreateBuffer(CBDesc, &CBData, &m_MobileTemplateCB);
+
+    BindConstantBuffers(m_pMobilePSO);
+    m_pMobilePSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "MobileTemplate")->Set(m_MobileTemplateCB);
+    m_pMobilePSO->CreateShaderResourceBinding(&m_MobileSRB, true);
+
+    CreatePrepassPipelines(CubePsoCI, m_MobilePrepass);
+    m_MobilePrepass.pDepthPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "MobileTemplate")->Set(m_MobileTemplateCB);
+    m_MobilePrepass.pEqualPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "MobileTemplate")->Set(m_MobileTemplateCB);
+    m_MobilePrepass.pDepthPSO->CreateShaderResourceBinding(&m_MobilePrepass.pDepthSRB, true);
+
+    CreateBlitPipelineState(pShaderSourceFactory);
+
+    // clang-format off
+    // Split instance streams pipeline: static part attributes and the per-mobile angle
+    // are fetched from two separate per-instance vertex buffers.
+    LayoutElement SplitLayoutElems[] =
+    {
+        // Per-vertex data - first buffer slot
+        // Attribute 0 - vertex position
+        LayoutElement{0, 0, 3, VT_FLOAT32, False},
+        // Attribute 1 - texture coordinates
+        LayoutElement{1, 0, 2, VT_FLOAT32, False},
+
+        // Static per-instance data - second buffer slot
+        // Attribute 2 - part scale
+        LayoutElement{2, 1, 3, VT_FLOAT32, False, INPUT_ELEMENT_FREQUENCY_PER_INSTANCE},
+        // Attribute 3 - part offset
+        LayoutElement{3, 1, 3, VT_FLOAT32, False, INPUT_ELEMENT_FREQUENCY_PER_INSTANCE},
+        // Attribute 4 - mobile position
+        LayoutElement{4, 1, 3, VT_FLOAT32, False, INPUT_ELEMENT_FREQUENCY_PER_INSTANCE},
+
+        // Dynamic per-mobile data - third buffer slot
+        // Attribute 5 - mobile rotation angle
+        LayoutElement{5, 2, 1, VT_FLOAT32, False, INPUT_ELEMENT_FREQUENCY_PER_INSTANCE, MobileTemplate::NumParts}
+    };
+    // clang-format on
+
+    CubePsoCI.VSFilePath             = "cube_inst_split.vsh";
+    CubePsoCI.ExtraLayoutElements    = SplitLayoutElems;
+    CubePsoCI.NumExtraLayoutElements = _countof(SplitLayoutElems);
+
+    m_pSplitPSO = TexturedCube::CreatePipelineState(CubePsoCI, m_ConvertPSOutputToGamma);
+    BindConstantBuffers(m_pSplitPSO);
+    m_pSplitPSO->CreateShaderResourceBinding(&m_SplitSRB, true);
+
+    CreatePrepassPipelines(CubePsoCI, m_SplitPrepass);
+    m_SplitPrepass.pDepthPSO->CreateShaderResourceBinding(&m_SplitPrepass.pDepthSRB, true);
+
+    // Structured buffers in the vertex shader require storage buffer support, which
+    // is available on all devices that support compute shaders
+    m_VertexPullingSupported = m_pDevice->GetDeviceInfo().Features.ComputeShaders;
+    if (m_VertexPullingSupported)
+    {
+        m_pPullPSO = CreatePullPipelineState(pShaderSourceFactory, false);
+        BindConstantBuffers(m_pPullPSO);
+        m_pPullIndexedPSO = CreatePullPipelineState(pShaderSourceFactory, true);
+        BindConstantBuffers(m_pPullIndexedPSO);
+
+        // Bindings of the pre-pass pipelines are created with the instance buffers
+        m_PullPrepass.pDepthPSO        = CreatePullPipelineState(pShaderSourceFactory, false, CUBE_PASS_DEPTH_ONLY);
+        m_PullPrepass.pEqualPSO        = CreatePullPipelineState(pShaderSourceFactory, false, CUBE_PASS_DEPTH_EQUAL);
+        m_PullIndexedPrepass.pDepthPSO = CreatePullPipelineState(pShaderSourceFactory, true, CUBE_PASS_DEPTH_ONLY);
+        m_PullIndexedPrepass.pEqualPSO = CreatePullPipelineState(pShaderSourceFactory, true, CUBE_PASS_DEPTH_EQUAL);
+        for (auto* pPSO : {m_PullPrepass.pDepthPSO.RawPtr(), m_PullPrepass.pEqualPSO.RawPtr(), m_PullIndexedPrepass.pDepthPSO.RawPtr(), m_PullIndexedPrepass.pEqualPSO.RawPtr()})
+            BindConstantBuffers(pPSO);
+
+        // Culled instances are drawn through the same instance indices as the sorted ones
+        CreateOcclusionCullingPipelines(pShaderSourceFactory);
+    }
+    else
+    {
+        m_VertexPulling    = false;
+        m_OcclusionCulling = false;
+    }
+}
+
+void Tutorial04_Instancing::CreateOcclusionCullingPipelines(IShaderSourceInputStreamFactory* pShaderSourceFactory)
+{
+    if (!m_pDevice->GetDeviceInfo().Features.ComputeShaders)
+    {
+        m_OcclusionCulling = false;
+        return;
+    }
+
+    ShaderCreateInfo ShaderCI;
+    ShaderCI.SourceLanguage = SHADER_SOURCE_LANGUAGE_HLSL;
+    // Pack matrices in row-major order
+    ShaderCI.CompileFlags = SHADER_COMPILE_FLAG_PACK_MATRIX_ROW_MAJOR;
+
+    ShaderCI.pShaderSourceStreamFactory = pShaderSourceFactory;
+    ShaderCI.Desc.ShaderType            = SHADER_TYPE_COMPUTE;
+    ShaderCI.EntryPoint                 = "main";
+
+    {
+        RefCntAutoPtr<IShader> pCS;
+        ShaderCI.Desc.Name = "Hi-Z build CS";
+        ShaderCI.FilePath  = "hiz_build.csh";
+        m_pDevice->CreateShader(ShaderCI, &pCS);
+
+        ComputePipelineStateCreateInfo PSOCreateInfo;
+        PSOCreateInfo.PSODesc.Name         = "Hi-Z build PSO";
+        PSOCreateInfo.PSODesc.PipelineType = PIPELINE_TYPE_COMPUTE;
+        PSOCreateInfo.pCS                  = pCS;
+        // Source and destination levels change with every dispatch
+        PSOCreateInfo.PSODesc.ResourceLayout.DefaultVariableType = SHADER_RESOURCE_VARIABLE_TYPE_DYNAMIC;
+
+        m_pDevice->CreateComputePipelineState(PSOCreateInfo, &m_pHiZBuildPSO);
+        m_pHiZBuildPSO->CreateShaderResourceBinding(&m_HiZBuildSRB, true);
+    }
+
+    {
+        RefCntAutoPtr<IShader> pCS;
+        ShaderCI.Desc.Name = "Instance culling CS";
+        ShaderCI.FilePath  = "instance_cull.csh";
+        m_pDevice->CreateShader(ShaderCI, &pCS);
+
+        ComputePipelineStateCreateInfo PSOCreateInfo;
+        PSOCreateInfo.PSODesc.Name         = "Instance culling PSO";
+        PSOCreateInfo.PSODesc.PipelineType = PIPELINE_TYPE_COMPUTE;
+        PSOCreateInfo.pCS                  = pCS;
+        // Buffers are recreated with the instance buffer and the Hi-Z buffer with the swap chain
+        PSOCreateInfo.PSODesc.ResourceLayout.DefaultVariableType = SHADER_RESOURCE_VARIABLE_TYPE_DYNAMIC;
+
+        // clang-format off
+        ShaderResourceVariableDesc Vars[] = 
+        {
+            {SHADER_TYPE_COMPUTE, "CullConstants", SHADER_RESOURCE_VARIABLE_TYPE_STATIC}
+        };
+        // clang-format on
+        PSOCreateInfo.PSODesc.ResourceLayout.Variables    = Vars;
+        PSOCreateInfo.PSODesc.ResourceLayout.NumVariables = _countof(Vars);
+
+        m_pDevice->CreateComputePipelineState(PSOCreateInfo, &m_pCullPSO);
+    }
+
+    CreateUniformBuffer(m_pDevice, sizeof(CullConstants), "Cull constants CB", &m_CullConstants, USAGE_DEFAULT, BIND_UNIFORM_BUFFER, CPU_ACCESS_NONE);
+    m_pCullPSO->GetStaticVariableByName(SHADER_TYPE_COMPUTE, "CullConstants")->Set(m_CullConstants);
+}
+
+RefCntAutoPtr<IPipelineState> Tutorial04_Instancing::CreatePullPipelineState(IShaderSourceInputStreamFactory* pShaderSourceFactory, bool UseInstanceIndices, CUBE_PASS Pass)
+{
+    GraphicsPipelineStateCreateInfo PSOCreateInfo;
+
+    const std::string Name = std::string{"Cube vertex pulling"} + (UseInstanceIndices ? " with instance indices" : "") + CubePassPSOSuffixes[Pass];
+    PSOCreateInfo.PSODesc.Name         = Name.c_str();
+    PSOCreateInfo.PSODesc.PipelineType = PIPELINE_TYPE_GRAPHICS;
+
+    SetCubePassStates(PSOCreateInfo.GraphicsPipeline, Pass);
+
+    ShaderCreateInfo ShaderCI;
+    ShaderCI.SourceLanguage = SHADER_SOURCE_LANGUAGE_HLSL;
+    // OpenGL backend requires emulated combined HLSL texture samplers (g_Texture + g_Texture_sampler combination)
+    ShaderCI.Desc.UseCombinedTextureSamplers = true;
+    // Pack matrices in row-major order
+    ShaderCI.CompileFlags = SHADER_COMPILE_FLAG_PACK_MATRIX_ROW_MAJOR;
+
+    ShaderCI.pShaderSourceStreamFactory = pShaderSourceFactory;
+
+    // clang-format off
+    ShaderMacro Macros[] =
+    {
+        {"CONVERT_PS_OUTPUT_TO_GAMMA", m_ConvertPSOutputToGamma ? "1" : "0"},
+        {"USE_INSTANCE_INDICES",       UseInstanceIndices ? "1" : "0"},
+        {"USE_GLOBAL_ROTATION",        UseGlobalRotation ? "1" : "0"}
+    };
+    // clang-format on
+    ShaderCI.Macros = {Macros, _countof(Macros)};
+
+    RefCntAutoPtr<IShader> pVS;
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_VERTEX;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Cube vertex pulling VS";
+        ShaderCI.FilePath        = "cube_inst_pull.vsh";
+        m_pDevice->CreateShader(ShaderCI, &pVS);
+    }
+
+    // The depth pre-pass does not need a pixel shader
+    RefCntAutoPtr<IShader> pPS;
+    if (Pass != CUBE_PASS_DEPTH_ONLY)
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_PIXEL;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Cube PS";
+        ShaderCI.FilePath        = "cube_inst.psh";
+        m_pDevice->CreateShader(ShaderCI, &pPS);
+    }
+
+    // clang-format off
+    // Only per-vertex data comes from the input layout
+    LayoutElement LayoutElems[] =
+    {
+        // Attribute 0 - vertex position
+        LayoutElement{0, 0, 3, VT_FLOAT32, False},
+        // Attribute 1 - texture coordinates
+        LayoutElement{1, 0, 2, VT_FLOAT32, False}
+    };
+    // clang-format on
+    PSOCreateInfo.GraphicsPipeline.InputLayout.LayoutElements = LayoutElems;
+    PSOCreateInfo.GraphicsPipeline.InputLayout.NumElements    = _countof(LayoutElems);
+
+    PSOCreateInfo.pVS = pVS;
+    PSOCreateInfo.pPS = pPS;
+
+    PSOCreateInfo.PSODesc.ResourceLayout.DefaultVariableType = SHADER_RESOURCE_VARIABLE_TYPE_STATIC;
+
+    // clang-format off
+    // Instance buffers are recreated when they grow, so they use dynamic variables
+    ShaderResourceVariableDesc Vars[] = 
+    {
+        {SHADER_TYPE_PIXEL,  "g_Texture",         SHADER_RESOURCE_VARIABLE_TYPE_MUTABLE},
+        {SHADER_TYPE_VERTEX, "g_Instances",       SHADER_RESOURCE_VARIABLE_TYPE_DYNAMIC},
+        {SHADER_TYPE_VERTEX, "g_InstanceIndices", SHADER_RESOURCE_VARIABLE_TYPE_DYNAMIC}
+    };
+    // clang-format on
+    // The texture is only used by the pixel shader
+    const Uint32 FirstVar = pPS ? 0 : 1;
+    PSOCreateInfo.PSODesc.ResourceLayout.Variables    = Vars + FirstVar;
+    PSOCreateInfo.PSODesc.ResourceLayout.NumVariables = (UseInstanceIndices ? _countof(Vars) : _countof(Vars) - 1) - FirstVar;
+
+    // clang-format off
+    SamplerDesc SamLinearClampDesc
+    {
+        FILTER_TYPE_LINEAR, FILTER_TYPE_LINEAR, FILTER_TYPE_LINEAR, 
+        TEXTURE_ADDRESS_CLAMP, TEXTURE_ADDRESS_CLAMP, TEXTURE_ADDRESS_CLAMP
+    };
+    ImmutableSamplerDesc ImtblSamplers[] = 
+    {
+        {SHADER_TYPE_PIXEL, "g_Texture", SamLinearClampDesc}
+    };
+    // clang-format on
+    PSOCreateInfo.PSODesc.ResourceLayout.ImmutableSamplers    = ImtblSamplers;
+    PSOCreateInfo.PSODesc.ResourceLayout.NumImmutableSamplers = pPS ? _countof(ImtblSamplers) : 0;
+
+    RefCntAutoPtr<IPipelineState> pPSO;
+    m_pDevice->CreateGraphicsPipelineState(PSOCreateInfo, &pPSO);
+    return pPSO;
+}
+
+void Tutorial04_Instancing::SetCubePassStates(GraphicsPipelineDesc& GraphicsPipeline, CUBE_PASS Pass) const
+{
+    const auto& SCDesc = m_pSwapChain->GetDesc();
+
+    // clang-format off
+    GraphicsPipeline.NumRenderTargets             = Pass == CUBE_PASS_DEPTH_ONLY ? 0 : 1;
+    GraphicsPipeline.RTVFormats[0]                = Pass == CUBE_PASS_DEPTH_ONLY ? TEX_FORMAT_UNKNOWN : SCDesc.ColorBufferFormat;
+    GraphicsPipeline.DSVFormat                    = SCDesc.DepthBufferFormat;
+    GraphicsPipeline.PrimitiveTopology            = PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    GraphicsPipeline.RasterizerDesc.CullMode      = CULL_MODE_BACK;
+    GraphicsPipeline.DepthStencilDesc.DepthEnable = True;
+    // clang-format on
+
+    if (Pass == CUBE_PASS_DEPTH_EQUAL)
+    {
+        // The pre-pass has already written the depth of the closest fragments. Both passes run the
+        // same vertex shader, so the closest fragments get exactly the same depth again.
+        GraphicsPipeline.DepthStencilDesc.DepthWriteEnable = False;
+        GraphicsPipeline.DepthStencilDesc.DepthFunc        = COMPARISON_FUNC_EQUAL;
+    }
+}
+
+RefCntAutoPtr<IPipelineState> Tutorial04_Instancing::CreateCubePassPipelineState(const TexturedCube::CreatePSOInfo& CubePsoCI, CUBE_PASS Pass)
+{
+    GraphicsPipelineStateCreateInfo PSOCreateInfo;
+
+    const std::string Name = std::string{"Cube "} + CubePsoCI.VSFilePath + CubePassPSOSuffixes[Pass];
+    PSOCreateInfo.PSODesc.Name         = Name.c_str();
+    PSOCreateInfo.PSODesc.PipelineType = PIPELINE_TYPE_GRAPHICS;
+    static_assert(_countof(CubePassPSOSuffixes) == CUBE_PASS_COUNT, "Please update CubePassPSOSuffixes");
+
+    SetCubePassStates(PSOCreateInfo.GraphicsPipeline, Pass);
+
+    ShaderCreateInfo ShaderCI;
+    ShaderCI.SourceLanguage = SHADER_SOURCE_LANGUAGE_HLSL;
+    // OpenGL backend requires emulated combined HLSL texture samplers (g_Texture + g_Texture_sampler combination)
+    ShaderCI.Desc.UseCombinedTextureSamplers = true;
+    // Pack matrices in row-major order
+    ShaderCI.CompileFlags = SHADER_COMPILE_FLAG_PACK_MATRIX_ROW_MAJOR;
+
+    ShaderCI.pShaderSourceStreamFactory = CubePsoCI.pShaderSourceFactory;
+
+    // Same macros as in the TexturedCube pipeline
+    ShaderMacro Macros[] = {{"CONVERT_PS_OUTPUT_TO_GAMMA", m_ConvertPSOutputToGamma ? "1" : "0"}};
+    ShaderCI.Macros      = {Macros, _countof(Macros)};
+
+    RefCntAutoPtr<IShader> pVS;
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_VERTEX;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Cube VS";
+        ShaderCI.FilePath        = CubePsoCI.VSFilePath;
+        m_pDevice->CreateShader(ShaderCI, &pVS);
+    }
+
+    // The depth pre-pass does not need a pixel shader
+    RefCntAutoPtr<IShader> pPS;
+    if (Pass != CUBE_PASS_DEPTH_ONLY)
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_PIXEL;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Cube PS";
+        ShaderCI.FilePath        = CubePsoCI.PSFilePath;
+        m_pDevice->CreateShader(ShaderCI, &pPS);
+    }
+
+    // The extra elements are the whole input layout of the TexturedCube pipeline
+    PSOCreateInfo.GraphicsPipeline.InputLayout.LayoutElements = CubePsoCI.ExtraLayoutElements;
+    PSOCreateInfo.GraphicsPipeline.InputLayout.NumElements    = CubePsoCI.NumExtraLayoutElements;
+
+    PSOCreateInfo.pVS = pVS;
+    PSOCreateInfo.pPS = pPS;
+
+    PSOCreateInfo.PSODesc.ResourceLayout.DefaultVariableType = SHADER_RESOURCE_VARIABLE_TYPE_STATIC;
+
+    // clang-format off
+    // Same resource layout as in the TexturedCube pipeline, so that its bindings can be used with the equal pipeline
+    ShaderResourceVariableDesc Vars[] = 
+    {
+        {SHADER_TYPE_PIXEL, "g_Texture", SHADER_RESOURCE_VARIABLE_TYPE_MUTABLE}
+    };
+    SamplerDesc SamLinearClampDesc
+    {
+        FILTER_TYPE_LINEAR, FILTER_TYPE_LINEAR, FILTER_TYPE_LINEAR, 
+        TEXTURE_ADDRESS_CLAMP, TEXTURE_ADDRESS_CLAMP, TEXTURE_ADDRESS_CLAMP
+    };
+    ImmutableSamplerDesc ImtblSamplers[] = 
+    {
+        {SHADER_TYPE_PIXEL, "g_Texture", SamLinearClampDesc}
+    };
+    // clang-format on
+    if (pPS)
+    {
+        PSOCreateInfo.PSODesc.ResourceLayout.Variables            = Vars;
+        PSOCreateInfo.PSODesc.ResourceLayout.NumVariables         = _countof(Vars);
+        PSOCreateInfo.PSODesc.ResourceLayout.ImmutableSamplers    = ImtblSamplers;
+        PSOCreateInfo.PSODesc.ResourceLayout.NumImmutableSamplers = _countof(ImtblSamplers);
+    }
+
+    RefCntAutoPtr<IPipelineState> pPSO;
+    m_pDevice->CreateGraphicsPipelineState(PSOCreateInfo, &pPSO);
+    return pPSO;
+}
+
+void Tutorial04_Instancing::CreatePrepassPipelines(const TexturedCube::CreatePSOInfo& CubePsoCI, PrepassPipelines& Pipelines)
+{
+    Pipelines.pDepthPSO = CreateCubePassPipelineState(CubePsoCI, CUBE_PASS_DEPTH_ONLY);
+    Pipelines.pEqualPSO = CreateCubePassPipelineState(CubePsoCI, CUBE_PASS_DEPTH_EQUAL);
+    BindConstantBuffers(Pipelines.pDepthPSO);
+    BindConstantBuffers(Pipelines.pEqualPSO);
+}
+
+void Tutorial04_Instancing::CreateBlitPipelineState(IShaderSourceInputStreamFactory* pShaderSourceFactory)
+{
+    GraphicsPipelineStateCreateInfo PSOCreateInfo;
+
+    PSOCreateInfo.PSODesc.Name         = "Frame cache blit PSO";
+    PSOCreateInfo.PSODesc.PipelineType = PIPELINE_TYPE_GRAPHICS;
+
+    // clang-format off
+    PSOCreateInfo.GraphicsPipeline.NumRenderTargets             = 1;
+    PSOCreateInfo.GraphicsPipeline.RTVFormats[0]                = m_pSwapChain->GetDesc().ColorBufferFormat;
+    PSOCreateInfo.GraphicsPipeline.DSVFormat                    = TEX_FORMAT_UNKNOWN;
+    PSOCreateInfo.GraphicsPipeline.PrimitiveTopology            = PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    PSOCreateInfo.GraphicsPipeline.RasterizerDesc.CullMode      = CULL_MODE_NONE;
+    PSOCreateInfo.GraphicsPipeline.DepthStencilDesc.DepthEnable = False;
+    // clang-format on
+
+    ShaderCreateInfo ShaderCI;
+    ShaderCI.SourceLanguage             = SHADER_SOURCE_LANGUAGE_HLSL;
+    ShaderCI.pShaderSourceStreamFactory = pShaderSourceFactory;
+
+    RefCntAutoPtr<IShader> pVS;
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_VERTEX;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Frame cache blit VS";
+        ShaderCI.FilePath        = "frame_cache.vsh";
+        m_pDevice->CreateShader(ShaderCI, &pVS);
+    }
+
+    RefCntAutoPtr<IShader> pPS;
+    {
+        ShaderCI.Desc.ShaderType = SHADER_TYPE_PIXEL;
+        ShaderCI.EntryPoint      = "main";
+        ShaderCI.Desc.Name       = "Frame cache blit PS";
+        ShaderCI.FilePath        = "frame_cache.psh";
+        m_pDevice->CreateShader(ShaderCI, &pPS);
+    }
+
+    PSOCreateInfo.pVS = pVS;
+    PSOCreateInfo.pPS = pPS;
+
+    // The cache texture is recreated when the window is resized together with the SRB
+    PSOCreateInfo.PSODesc.ResourceLayout.DefaultVariableType = SHADER_RESOURCE_VARIABLE_TYPE_MUTABLE;
+
+    m_pDevice->CreateGraphicsPipelineState(PSOCreateInfo, &m_pBlitPSO);
+}
+
+void Tutorial04_Instancing::CreateFrameCache(Uint32 Width, Uint32 Height)
+{
+    const auto& SCDesc = m_pSwapChain->GetDesc();
+
+    TextureDesc TexDesc;
+    TexDesc.Name      = "Frame cache color";
+    TexDesc.Type      = RESOURCE_DIM_TEX_2D;
+    TexDesc.Width     = Width;
+    TexDesc.Height    = Height;
+    TexDesc.Format    = SCDesc.ColorBufferFormat;
+    TexDesc.BindFlags = BIND_RENDER_TARGET | BIND_SHADER_RESOURCE;
+
+    RefCntAutoPtr<ITexture> pColor;
+    m_pDevice->CreateTexture(TexDesc, nullptr, &pColor);
+
+    TexDesc.Name      = "Frame cache depth";
+    TexDesc.Format    = SCDesc.DepthBufferFormat;
+    TexDesc.BindFlags = BIND_DEPTH_STENCIL;
+
+    RefCntAutoPtr<ITexture> pDepth;
+    m_pDevice->CreateTexture(TexDesc, nullptr, &pDepth);
+
+    m_FrameCacheValid = false;
+    m_FrameCacheRTV.Release();
+    m_FrameCacheDSV.Release();
+    m_BlitSRB.Release();
+    if (!pColor || !pDepth)
+    {
+        LOG_ERROR_MESSAGE("Failed to create ", Width, "x", Height, " frame cache");
+        return;
+    }
+    m_FrameCacheRTV = pColor->GetDefaultView(TEXTURE_VIEW_RENDER_TARGET);
+    m_FrameCacheDSV = pDepth->GetDefaultView(TEXTURE_VIEW_DEPTH_STENCIL);
+
+    m_pBlitPSO->CreateShaderResourceBinding(&m_BlitSRB, true);
+    m_BlitSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_FrameCache")->Set(pColor->GetDefaultView(TEXTURE_VIEW_SHADER_RESOURCE));
+}
+
+void Tutorial04_Instancing::UpdateFrameCache()
+{
+    if (!m_IdleMode)
+    {
+        // Release the cache when idle mode is disabled
+        m_FrameCacheRTV.Release();
+        m_FrameCacheDSV.Release();
+        m_BlitSRB.Release();
+        m_FrameCacheValid = false;
+        return;
+    }
+
+    const auto& SCDesc = m_pSwapChain->GetDesc();
+    if (!m_FrameCacheRTV || m_FrameCacheRTV->GetTexture()->GetDesc().Width != SCDesc.Width || m_FrameCacheRTV->GetTexture()->GetDesc().Height != SCDesc.Height)
+        CreateFrameCache(SCDesc.Width, SCDesc.Height);
+
+    // The scene is rendered again on any change of the camera, the UI state or the instance data
+    FrameState State;
+    State.ViewProj               = m_ViewProjMatrix;
+    State.Rotation               = m_RotationMatrix;
+    State.MobileAngle            = m_MobileAngle;
+    State.InstanceDataGeneration = m_InstanceDataGeneration;
+    State.Layout                 = m_GeneratedLayout;
+    State.VertexPulling          = m_VertexPulling;
+    if (State != m_CachedFrameState)
+        m_FrameCacheValid = false;
+    m_CachedFrameState = State;
+}
+
+void Tutorial04_Instancing::CreateHiZ(Uint32 Width, Uint32 Height)
+{
+    const auto& SCDesc = m_pSwapChain->GetDesc();
+
+    TextureDesc TexDesc;
+    TexDesc.Name      = "Scene depth";
+    TexDesc.Type      = RESOURCE_DIM_TEX_2D;
+    TexDesc.Width     = Width;
+    TexDesc.Height    = Height;
+    TexDesc.Format    = SCDesc.DepthBufferFormat;
+    TexDesc.BindFlags = BIND_DEPTH_STENCIL | BIND_SHADER_RESOURCE;
+
+    RefCntAutoPtr<ITexture> pDepth;
+    m_pDevice->CreateTexture(TexDesc, nullptr, &pDepth);
+
+    // The first level has half the resolution of the depth buffer, and the chain goes down to 1x1
+    TexDesc.Name      = "Hi-Z";
+    TexDesc.Width     = std::max(Width / 2, 1u);
+    TexDesc.Height    = std::max(Height / 2, 1u);
+    TexDesc.Format    = TEX_FORMAT_R32_FLOAT;
+    TexDesc.BindFlags = BIND_SHADER_RESOURCE | BIND_UNORDERED_ACCESS;
+    TexDesc.MipLevels = 1;
+    while ((std::max(TexDesc.Width, TexDesc.Height) >> TexDesc.MipLevels) != 0)
+        ++TexDesc.MipLevels;
+
+    m_HiZ.Release();
+    m_HiZValid = false;
+    m_SceneDepthDSV.Release();
+    m_HiZMipSRVs.clear();
+    m_HiZMipUAVs.clear();
+    if (!pDepth)
+    {
+        LOG_ERROR_MESSAGE("Failed to create ", Width, "x", Height, " scene depth buffer");
+        return;
+    }
+    m_pDevice->CreateTexture(TexDesc, nullptr, &m_HiZ);
+    if (!m_HiZ)
+    {
+        LOG_ERROR_MESSAGE("Failed to create ", TexDesc.Width, "x", TexDesc.Height, " Hi-Z buffer");
+        return;
+    }
+    m_SceneDepthDSV = pDepth->GetDefaultView(TEXTURE_VIEW_DEPTH_STENCIL);
+
+    // Every level is written through its own view while the previous level is read through another one
+    m_HiZMipSRVs.resize(TexDesc.MipLevels);
+    m_HiZMipUAVs.resize(TexDesc.MipLevels);
+    for (Uint32 Mip = 0; Mip < TexDesc.MipLevels; ++Mip)
+    {
+        TextureViewDesc ViewDesc;
+        ViewDesc.MostDetailedMip = Mip;
+        ViewDesc.NumMipLevels    = 1;
+        ViewDesc.ViewType        = TEXTURE_VIEW_SHADER_RESOURCE;
+        m_HiZ->CreateView(ViewDesc, &m_HiZMipSRVs[Mip]);
+        ViewDesc.ViewType = TEXTURE_VIEW_UNORDERED_ACCESS;
+        m_HiZ->CreateView(ViewDesc, &m_HiZMipUAVs[Mip]);
+    }
+
+    // The culling pass may read the buffer before it is built for the first time
+    StateTransitionDesc Barrier{m_HiZ, RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_SHADER_RESOURCE, STATE_TRANSITION_FLAG_UPDATE_STATE};
+    m_pImmediateContext->TransitionResourceStates(1, &Barrier);
+}
+
+void Tutorial04_Instancing::UpdateOcclusionCulling()
+{
+    if (!m_OcclusionCulling || !m_VertexPulling || !m_pCullPSO)
+    {
+        // Release the buffers when culling is disabled
+        m_SceneDepthDSV.Release();
+        m_HiZ.Release();
+        m_HiZMipSRVs.clear();
+        m_HiZMipUAVs.clear();
+        m_HiZValid = false;
+        return;
+    }
+
+    const auto& SCDesc = m_pSwapChain->GetDesc();
+    if (!m_SceneDepthDSV || m_SceneDepthDSV->GetTexture()->GetDesc().Width != SCDesc.Width || m_SceneDepthDSV->GetTexture()->GetDesc().Height != SCDesc.Height)
+        CreateHiZ(SCDesc.Width, SCDesc.Height);
+}
+
+bool Tutorial04_Instancing::UseOcclusionCulling(const FrameResources& Res) const
+{
+    return m_OcclusionCulling && m_HiZ && Res.pCullSRB;
+}
+
+void Tutorial04_Instancing::TransitionBufferState(IBuffer* pBuffer, RESOURCE_STATE NewState)
+{
+    StateTransitionDesc Barrier{pBuffer, RESOURCE_STATE_UNKNOWN, NewState, STATE_TRANSITION_FLAG_UPDATE_STATE};
+    m_pImmediateContext->TransitionResourceStates(1, &Barrier);
+}
+
+void Tutorial04_Instancing::BindConstantBuffers(IPipelineState* pPSO)
+{
+    // Shaders only declare the constant buffers they use
+    if (auto* pVar = pPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "ViewConstants"))
+        pVar->Set(m_ViewConstants);
+    if (auto* pVar = pPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "FrameConstants"))
+        pVar->Set(m_FrameConstants);
+    if (auto* pVar = pPSO->GetStaticVariableByName(SHADER_TYPE_VERTEX, "StaticConstants"))
+        pVar->Set(m_StaticConstants);
+}
+
+void Tutorial04_Instancing::UpdateConstantBuffer(IBuffer* pBuffer, const void* pData, Uint64 Size)
+{
+    m_pImmediateContext->UpdateBuffer(pBuffer, 0, Size, pData, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    // The update leaves the buffer in the copy destination state
+    TransitionBufferState(pBuffer, RESOURCE_STATE_CONSTANT_BUFFER);
+}
+
+void Tutorial04_Instancing::UpdateConstantBuffers()
+{
+    // The view changes when the camera moves, the frame constants while the mobiles are
+    // animated, and the static constants practically never
+    Uint32 NumUpdates = 0;
+    if (!m_ConstantsUploaded || m_ViewProjMatrix != m_UploadedViewProj)
+    {
+        const ViewConstants Data{m_ViewProjMatrix};
+        UpdateConstantBuffer(m_ViewConstants, &Data, sizeof(Data));
+        m_UploadedViewProj = m_ViewProjMatrix;
+        ++NumUpdates;
+    }
+    if (!m_ConstantsUploaded || m_MobileAngle != m_UploadedMobileAngle)
+    {
+        const FrameConstants Data{float4{m_MobileAngle, 0, 0, 0}};
+        UpdateConstantBuffer(m_FrameConstants, &Data, sizeof(Data));
+        m_UploadedMobileAngle = m_MobileAngle;
+        ++NumUpdates;
+    }
+    if (UseGlobalRotation && (!m_ConstantsUploaded || m_RotationMatrix != m_UploadedRotation))
+    {
+        const StaticConstants Data{m_RotationMatrix};
+        UpdateConstantBuffer(m_StaticConstants, &Data, sizeof(Data));
+        m_UploadedRotation = m_RotationMatrix;
+        ++NumUpdates;
+    }
+    m_ConstantsUploaded = true;
+    T4_PROFILE_COUNTER("ConstantBufferUpdates", NumUpdates);
+}
+
+void Tutorial04_Instancing::CreatePlacementBuffer()
+{
+    static_assert(sizeof(MobilePlacement) == sizeof(float4), "Placements are read by the vertex shader as float4");
+
+    // Placements only change with the scene layout, so the buffer is recreated in that case
+    BufferDesc PlacementBuffDesc;
+    PlacementBuffDesc.Name      = "Mobile placement buffer";
+    PlacementBuffDesc.Usage     = USAGE_IMMUTABLE;
+    PlacementBuffDesc.BindFlags = BIND_VERTEX_BUFFER;
+    PlacementBuffDesc.Size      = sizeof(MobilePlacement) * m_Placements.size();
+    BufferData PlacementData;
+    PlacementData.pData    = m_Placements.data();
+    PlacementData.DataSize = PlacementBuffDesc.Size;
+
+    m_PlacementBuffer.Release();
+    m_pDevice->CreateBuffer(PlacementBuffDesc, &PlacementData, &m_PlacementBuffer);
+    if (m_PlacementBuffer)
+        TransitionBufferState(m_PlacementBuffer, RESOURCE_STATE_VERTEX_BUFFER);
+    T4_PROFILE_COUNTER("PlacementBufferBytes", PlacementBuffDesc.Size);
+}
+
+void Tutorial04_Instancing::CreateSplitInstanceStreams()
+{
+    static_assert(sizeof(StaticInstanceAttribs) == sizeof(float) * 9, "Static instance attributes must be tightly packed");
+
+    // The static stream contains everything except the rotation and is only uploaded when the scene layout changes
+    std::vector<StaticInstanceAttribs> StaticAttribs(m_Placements.size() * MobileTemplate::NumParts);
+    for (size_t m = 0; m < m_Placements.size(); ++m)
+    {
+        for (Uint32 i = 0; i < MobileTemplate::NumParts; ++i)
+        {
+            const auto& Part = MobileTemplate::GetPart(i);
+            auto&       Dst  = StaticAttribs[m * MobileTemplate::NumParts + i];
+
+            Dst.PartScale      = Part.Scale;
+            Dst.PartOffset     = Part.Offset;
+            Dst.MobilePosition = m_Placements[m].Position;
+        }
+    }
+
+    BufferDesc StaticBuffDesc;
+    StaticBuffDesc.Name      = "Static instance stream";
+    StaticBuffDesc.Usage     = USAGE_IMMUTABLE;
+    StaticBuffDesc.BindFlags = BIND_VERTEX_BUFFER;
+    StaticBuffDesc.Size      = sizeof(StaticInstanceAttribs) * StaticAttribs.size();
+    BufferData StaticData;
+    StaticData.pData    = StaticAttribs.data();
+    StaticData.DataSize = StaticBuffDesc.Size;
+
+    m_StaticInstanceStream.Release();
+    m_pDevice->CreateBuffer(StaticBuffDesc, &StaticData, &m_StaticInstanceStream);
+    if (m_StaticInstanceStream)
+        TransitionBufferState(m_StaticInstanceStream, RESOURCE_STATE_VERTEX_BUFFER);
+
+    // The dynamic stream only contains one angle per mobile and is written every frame
+    BufferDesc DynamicBuffDesc;
+    DynamicBuffDesc.Name           = "Dynamic instance stream";
+    DynamicBuffDesc.Usage          = USAGE_DYNAMIC;
+    DynamicBuffDesc.BindFlags      = BIND_VERTEX_BUFFER;
+    DynamicBuffDesc.CPUAccessFlags = CPU_ACCESS_WRITE;
+    DynamicBuffDesc.Size           = sizeof(float) * m_Placements.size();
+
+    m_DynamicInstanceStream.Release();
+    m_pDevice->CreateBuffer(DynamicBuffDesc, nullptr, &m_DynamicInstanceStream);
+    T4_PROFILE_COUNTER("StaticInstanceStreamBytes", StaticBuffDesc.Size);
+}
+
+void Tutorial04_Instancing::UpdateDynamicInstanceStream()
+{
+    // Contents of dynamic buffers are only valid in the frame they were mapped in, so all angles are written every frame
+    MapHelper<float> Angles(m_pImmediateContext, m_DynamicInstanceStream, MAP_WRITE, MAP_FLAG_DISCARD);
+    for (size_t m = 0; m < m_Placements.size(); ++m)
+        Angles[m] = m_MobileAngle + m_Placements[m].Phase;
+    T4_PROFILE_COUNTER("DynamicInstanceStreamBytes", sizeof(float) * m_Placements.size());
+}
+
+void Tutorial04_Instancing::CreateInstanceBuffer()
+{
+    // The instance buffer is created on demand and resized to fit the instance data
+    PopulateInstanceBuffer(0);
+}
+
+Tutorial04_Instancing::FrameResources& Tutorial04_Instancing::AcquireFrameResources()
+{
+    m_FrameResIndex = (m_FrameResIndex + 1) % m_NumFramesInFlight;
+    auto& Res       = m_FrameResources[m_FrameResIndex];
+
+    // The resources were last used NumFramesInFlight frames ago. The CPU only stalls
+    // if the GPU has not finished that frame yet.
+    if (m_pFrameFence->GetCompletedValue() < Res.FenceValue)
+    {
+        T4_PROFILE_ZONE("WaitForFrameResources");
+        ++m_NumFrameResourceStalls;
+        m_pFrameFence->Wait(Res.FenceValue);
+    }
+    T4_PROFILE_COUNTER("FrameResourceStalls", m_NumFrameResourceStalls);
 
-    // Since we are using mutable variable, we must create a shader resource binding object
-    // http://diligentgraphics.com/2016/03/23/resource-binding-model-in-diligent-engine-2-0/
-    m_pPSO->CreateShaderResourceBinding(&m_SRB, true);
+    if (Res.CullStatsPending)
+        ReadCullingStats(Res);
+    return Res;
 }
 
-void Tutorial04_Instancing::CreateInstanceBuffer()
+bool Tutorial04_Instancing::ReserveInstanceBuffer(FrameResources& Res, Uint64 NumInstances)
 {
+    // Grow geometrically to amortize reallocations. Shrink only when less than a quarter
+    // of the buffer is used, so that the size does not oscillate around a threshold.
+    Uint64 NewCapacity = Res.InstanceBufferCapacity;
+    if (NumInstances > Res.InstanceBufferCapacity)
+        NewCapacity = std::max(NumInstances, Res.InstanceBufferCapacity * 2);
+    else if (NumInstances < Res.InstanceBufferCapacity / 4)
+        NewCapacity = std::max(NumInstances * 2, MinInstanceBufferCapacity);
+    NewCapacity = std::max(NewCapacity, MinInstanceBufferCapacity);
+
+    // Structured buffers can't be bound as vertex buffers, so switching between the input
+    // layout and vertex pulling also recreates the buffer
+    if (Res.pInstanceBuffer && NewCapacity == Res.InstanceBufferCapacity && Res.IsStructured == m_VertexPulling)
+        return false;
+
     // Create instance data buffer that will store transformation matrices
     BufferDesc InstBuffDesc;
     InstBuffDesc.Name = "Instance data buffer";
     // Use default usage as this buffer will only be updated when grid size changes
-    InstBuffDesc.Usage     = USAGE_DEFAULT;
-    InstBuffDesc.BindFlags = BIND_VERTEX_BUFFER;
-    InstBuffDesc.Size      = sizeof(float4x4) * MaxInstances;
-    m_pDevice->CreateBuffer(InstBuffDesc, nullptr, &m_InstanceBuffer);
-    PopulateInstanceBuffer();
+    InstBuffDesc.Usage = USAGE_DEFAULT;
+    InstBuffDesc.Size  = sizeof(float4x4) * NewCapacity;
+    if (m_VertexPulling)
+    {
+        InstBuffDesc.BindFlags         = BIND_SHADER_RESOURCE;
+        InstBuffDesc.Mode              = BUFFER_MODE_STRUCTURED;
+        InstBuffDesc.ElementByteStride = sizeof(float4x4);
+    }
+    else
+    {
+        InstBuffDesc.BindFlags = BIND_VERTEX_BUFFER;
+    }
+
+    // The old buffer is kept alive by the engine until the GPU is done with it
+    Res.pInstanceBuffer.Release();
+    m_pDevice->CreateBuffer(InstBuffDesc, nullptr, &Res.pInstanceBuffer);
+    if (!Res.pInstanceBuffer)
+    {
+        LOG_ERROR_MESSAGE("Failed to create instance buffer for ", NewCapacity, " instances");
+        Res.InstanceBufferCapacity = 0;
+        return false;
+    }
+    Res.InstanceBufferCapacity = NewCapacity;
+    Res.IsStructured           = m_VertexPulling;
+    Res.DrawPacketsDirty       = true;
+
+    // Every frame in flight has its own binding, so the binding does not change after it is created
+    Res.pPullSRB.Release();
+    Res.pPullDepthSRB.Release();
+    if (m_VertexPulling)
+    {
+        auto* pInstancesSRV = Res.pInstanceBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE);
+        m_pPullPSO->CreateShaderResourceBinding(&Res.pPullSRB, true);
+        Res.pPullSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+        Res.pPullSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+        m_PullPrepass.pDepthPSO->CreateShaderResourceBinding(&Res.pPullDepthSRB, true);
+        Res.pPullDepthSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+    }
+
+    // The order buffer has the same capacity as the instance buffer, so depth sorting
+    // can be toggled without recreating any buffers
+    Res.pOrderBuffer.Release();
+    Res.pSortedPullSRB.Release();
+    Res.pSortedPullDepthSRB.Release();
+    Res.UploadedOrder = ~Uint64{0};
+    if (m_VertexPulling && m_pPullIndexedPSO)
+    {
+        BufferDesc OrderBuffDesc;
+        OrderBuffDesc.Name              = "Instance order buffer";
+        OrderBuffDesc.Usage             = USAGE_DEFAULT;
+        OrderBuffDesc.BindFlags         = BIND_SHADER_RESOURCE;
+        OrderBuffDesc.Mode              = BUFFER_MODE_STRUCTURED;
+        OrderBuffDesc.ElementByteStride = sizeof(Uint32);
+        OrderBuffDesc.Size              = sizeof(Uint32) * NewCapacity;
+        m_pDevice->CreateBuffer(OrderBuffDesc, nullptr, &Res.pOrderBuffer);
+        if (Res.pOrderBuffer)
+        {
+            auto* pInstancesSRV = Res.pInstanceBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE);
+            auto* pOrderSRV     = Res.pOrderBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE);
+            m_pPullIndexedPSO->CreateShaderResourceBinding(&Res.pSortedPullSRB, true);
+            Res.pSortedPullSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+            Res.pSortedPullSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+            Res.pSortedPullSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_InstanceIndices")->Set(pOrderSRV);
+            m_PullIndexedPrepass.pDepthPSO->CreateShaderResourceBinding(&Res.pSortedPullDepthSRB, true);
+            Res.pSortedPullDepthSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+            Res.pSortedPullDepthSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_InstanceIndices")->Set(pOrderSRV);
+            // The culling pass reads the order even if it has never been uploaded
+            TransitionBufferState(Res.pOrderBuffer, RESOURCE_STATE_SHADER_RESOURCE);
+        }
+    }
+
+    // Occlusion culling compacts the indices of the visible instances and counts them
+    // in the arguments of the indirect draw
+    Res.pVisibleBuffer.Release();
+    Res.pDrawArgsBuffer.Release();
+    Res.pDrawArgsUAV.Release();
+    Res.pDrawArgsReadback.Release();
+    Res.pCullSRB.Release();
+    Res.pCulledPullSRB.Release();
+    Res.pCulledPullDepthSRB.Release();
+    Res.CullStatsPending = false;
+    if (Res.pOrderBuffer && m_pCullPSO)
+    {
+        BufferDesc VisibleBuffDesc;
+        VisibleBuffDesc.Name              = "Visible instance buffer";
+        VisibleBuffDesc.Usage             = USAGE_DEFAULT;
+        VisibleBuffDesc.BindFlags         = BIND_SHADER_RESOURCE | BIND_UNORDERED_ACCESS;
+        VisibleBuffDesc.Mode              = BUFFER_MODE_STRUCTURED;
+        VisibleBuffDesc.ElementByteStride = sizeof(Uint32);
+        VisibleBuffDesc.Size              = sizeof(Uint32) * NewCapacity;
+        m_pDevice->CreateBuffer(VisibleBuffDesc, nullptr, &Res.pVisibleBuffer);
+
+        BufferDesc ArgsBuffDesc;
+        ArgsBuffDesc.Name              = "Culled draw arguments buffer";
+        ArgsBuffDesc.Usage             = USAGE_DEFAULT;
+        ArgsBuffDesc.BindFlags         = BIND_INDIRECT_DRAW_ARGS | BIND_UNORDERED_ACCESS;
+        ArgsBuffDesc.Mode              = BUFFER_MODE_FORMATTED;
+        ArgsBuffDesc.ElementByteStride = sizeof(Uint32);
+        ArgsBuffDesc.Size              = sizeof(CulledDrawArgs);
+        m_pDevice->CreateBuffer(ArgsBuffDesc, nullptr, &Res.pDrawArgsBuffer);
+
+        BufferDesc ReadbackBuffDesc;
+        ReadbackBuffDesc.Name           = "Culled draw arguments readback buffer";
+        ReadbackBuffDesc.Usage          = USAGE_STAGING;
+        ReadbackBuffDesc.CPUAccessFlags = CPU_ACCESS_READ;
+        ReadbackBuffDesc.Size           = sizeof(CulledDrawArgs);
+        m_pDevice->CreateBuffer(ReadbackBuffDesc, nullptr, &Res.pDrawArgsReadback);
+
+        if (Res.pVisibleBuffer && Res.pDrawArgsBuffer && Res.pDrawArgsReadback)
+        {
+            BufferViewDesc ArgsUAVDesc;
+            ArgsUAVDesc.ViewType             = BUFFER_VIEW_UNORDERED_ACCESS;
+            ArgsUAVDesc.Format.ValueType     = VT_UINT32;
+            ArgsUAVDesc.Format.NumComponents = 1;
+            Res.pDrawArgsBuffer->CreateView(ArgsUAVDesc, &Res.pDrawArgsUAV);
+
+            auto* pInstancesSRV = Res.pInstanceBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE);
+            auto* pVisibleSRV   = Res.pVisibleBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE);
+            m_pCullPSO->CreateShaderResourceBinding(&Res.pCullSRB, true);
+            Res.pCullSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_Instances")->Set(pInstancesSRV);
+            Res.pCullSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_InstanceOrder")->Set(Res.pOrderBuffer->GetDefaultView(BUFFER_VIEW_SHADER_RESOURCE));
+            Res.pCullSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_VisibleIndices")->Set(Res.pVisibleBuffer->GetDefaultView(BUFFER_VIEW_UNORDERED_ACCESS));
+            Res.pCullSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_DrawArgs")->Set(Res.pDrawArgsUAV);
+            m_pPullIndexedPSO->CreateShaderResourceBinding(&Res.pCulledPullSRB, true);
+            Res.pCulledPullSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+            Res.pCulledPullSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+            Res.pCulledPullSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_InstanceIndices")->Set(pVisibleSRV);
+            m_PullIndexedPrepass.pDepthPSO->CreateShaderResourceBinding(&Res.pCulledPullDepthSRB, true);
+            Res.pCulledPullDepthSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_Instances")->Set(pInstancesSRV);
+            Res.pCulledPullDepthSRB->GetVariableByName(SHADER_TYPE_VERTEX, "g_InstanceIndices")->Set(pVisibleSRV);
+        }
+    }
+    T4_PROFILE_COUNTER("InstanceBufferBytes", InstBuffDesc.Size);
+    return true;
 }
 
 void Tutorial04_Instancing::UpdateUI()
 {
+    T4_PROFILE_ZONE("UpdateUI");
+
     ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
     if (ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
     {
-        if (ImGui::SliderInt("Grid Size", &m_GridSize, 32, 32))
+        ImGui::Text("Scene");
+        ImGui::RadioButton("Mobile", &m_SceneMode, SCENE_MODE_MOBILE);
+        ImGui::RadioButton("Grid stress", &m_SceneMode, SCENE_MODE_GRID_STRESS);
+        ImGui::RadioButton("Many mobiles", &m_SceneMode, SCENE_MODE_MANY_MOBILES);
+        if (m_SceneMode == SCENE_MODE_GRID_STRESS)
+        {
+            ImGui::SliderInt("Grid Size", &m_GridSize, 1, MaxGridSize);
+        }
+        else if (m_SceneMode == SCENE_MODE_MANY_MOBILES)
+        {
+            ImGui::SliderInt("Mobiles", &m_NumMobiles, 1, MaxNumMobiles);
+        }
+
+        ImGui::Text("Mobile instancing");
+        ImGui::RadioButton("CPU matrices", &m_MobileInstancing, MOBILE_INSTANCING_CPU_MATRICES);
+        ImGui::RadioButton("GPU template", &m_MobileInstancing, MOBILE_INSTANCING_GPU_TEMPLATE);
+        ImGui::RadioButton("Split streams", &m_MobileInstancing, MOBILE_INSTANCING_SPLIT_STREAMS);
+        if (m_VertexPullingSupported)
+            ImGui::Checkbox("Vertex pulling", &m_VertexPulling);
+        if (m_VertexPulling)
         {
-            PopulateInstanceBuffer();
+            ImGui::Checkbox("Depth sort", &m_DepthSort);
+            ImGui::Checkbox("Occlusion culling", &m_OcclusionCulling);
+            if (m_OcclusionCulling)
+                ImGui::Text("%u of %u instances culled", m_NumCulledInstances, m_NumTestedInstances);
         }
+        ImGui::Checkbox("Depth pre-pass", &m_DepthPrepass);
+        if (m_PrepassGpuTimer)
+        {
+            ImGui::Text("GPU scene: %.3f ms without pre-pass", m_SceneGpuTime[0] * 1000.0);
+            ImGui::Text("GPU scene: %.3f ms with pre-pass (%.3f ms depth)", m_SceneGpuTime[1] * 1000.0, m_PrepassGpuTime * 1000.0);
+        }
+        ImGui::Text("%d instances", static_cast<int>(m_InstanceData.size()));
+        ImGui::Checkbox("Animate", &m_AnimateMobile);
+        ImGui::Checkbox("Idle when unchanged", &m_IdleMode);
+#if T4_DRAW_VALIDATION_ENABLED
+        ImGui::Text("Draw validation");
+        ImGui::RadioButton("None", &m_DrawValidation, DRAW_VALIDATION_NONE);
+        ImGui::SameLine();
+        ImGui::RadioButton("States", &m_DrawValidation, DRAW_VALIDATION_STATES);
+        ImGui::SameLine();
+        ImGui::RadioButton("Full", &m_DrawValidation, DRAW_VALIDATION_FULL);
+#endif
+
         ImGui::Text("Camera View");
         ImGui::RadioButton("Default", &m_CameraMode, 0);
         ImGui::RadioButton("Front", &m_CameraMode, 1);
         ImGui::RadioButton("Top", &m_CameraMode, 2);
         ImGui::RadioButton("Side", &m_CameraMode, 3);
         ImGui::RadioButton("Bottom", &m_CameraMode, 4);
+
+#if T4_PROFILER_ENABLED
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Profiler"))
+        {
+            m_ProfilerOverlay.Draw();
+        }
+
+        ImGui::Separator();
+        bool RecordTrace = m_Trace.IsEnabled();
+        if (ImGui::Checkbox("Record trace", &RecordTrace))
+            m_Trace.SetEnabled(RecordTrace);
+        ImGui::SameLine();
+        ImGui::Text("%d / %d events", static_cast<int>(m_Trace.GetNumEvents()), static_cast<int>(m_Trace.GetCapacity()));
+        if (ImGui::Button("Dump trace"))
+        {
+            m_Trace.WriteChromeTrace(m_TraceFilePath.c_str());
+        }
+#endif
+
+        ImGui::Separator();
+        if (m_FrameRecorder.IsReplaying())
+        {
+            ImGui::Text("Replaying frame %d / %d", static_cast<int>(m_FrameRecorder.GetReplayPosition()), static_cast<int>(m_FrameRecorder.GetNumReplayFrames()));
+            if (ImGui::Button("Stop replay"))
+                m_FrameRecorder.StopReplay();
+        }
+        else if (m_FrameRecorder.IsRecording())
+        {
+            ImGui::Text("Recording: %d frames", static_cast<int>(m_FrameRecorder.GetNumRecordedFrames()));
+            if (ImGui::Button("Stop recording"))
+                m_FrameRecorder.StopRecording();
+        }
+        else
+        {
+            if (ImGui::Button("Record frames"))
+                m_FrameRecorder.StartRecording(m_RecordFilePath.c_str());
+            ImGui::SameLine();
+            if (ImGui::Button("Replay frames"))
+                m_FrameRecorder.LoadReplay(m_RecordFilePath.c_str());
+        }
     }
     ImGui::End();
 }
 
 
+void Tutorial04_Instancing::ModifyEngineInitInfo(const ModifyEngineInitInfoAttribs& Attribs)
+{
+    SampleBase::ModifyEngineInitInfo(Attribs);
+    // Timestamp queries are used for the GPU timings of the scene
+    Attribs.EngineCI.Features.TimestampQueries = DEVICE_FEATURE_STATE_OPTIONAL;
+}
+
 void Tutorial04_Instancing::Initialize(const SampleInitInfo& InitInfo)
 {
     SampleBase::Initialize(InitInfo);
 
+    m_JobSystem = std::make_unique<JobSystem>(m_NumWorkerThreads);
+
+#if T4_PROFILER_ENABLED
+    Profiler::AddSink(&m_Trace);
+    Profiler::AddSink(&m_ProfilerOverlay);
+#endif
+
+    // The simulation thread emits profiler events, so it is started after the sinks are registered
+    m_Simulation = std::make_unique<MobileSimulation>(m_MobileAngle);
+
     CreatePipelineState();
 
     // Load textured cube
     m_CubeVertexBuffer = TexturedCube::CreateVertexBuffer(m_pDevice, GEOMETRY_PRIMITIVE_VERTEX_FLAG_POS_TEX);
     m_CubeIndexBuffer  = TexturedCube::CreateIndexBuffer(m_pDevice);
-    m_TextureSRV       = TexturedCube::LoadTexture(m_pDevice, "DGLogo.png")->GetDefaultView(TEXTURE_VIEW_SHADER_RESOURCE);
+    m_TextureSRV       = TexturedCube::LoadTexture(m_pDevice, (m_AssetDir.empty() ? std::string{"DGLogo.png"} : m_AssetDir + "/DGLogo.png").c_str())->GetDefaultView(TEXTURE_VIEW_SHADER_RESOURCE);
     // Set cube texture SRV in the SRB
     m_SRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+    m_MobileSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+    m_SplitSRB->GetVariableByName(SHADER_TYPE_PIXEL, "g_Texture")->Set(m_TextureSRV);
+
+    // Static resources are transitioned to their final states once. The render loop only verifies
+    // the states and issues explicit barriers after uploads.
+    // clang-format off
+    StateTransitionDesc Barriers[] =
+    {
+        {m_CubeVertexBuffer,         RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_VERTEX_BUFFER,   STATE_TRANSITION_FLAG_UPDATE_STATE},
+        {m_CubeIndexBuffer,          RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_INDEX_BUFFER,    STATE_TRANSITION_FLAG_UPDATE_STATE},
+        {m_MobileTemplateCB,         RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_CONSTANT_BUFFER, STATE_TRANSITION_FLAG_UPDATE_STATE},
+        {m_TextureSRV->GetTexture(), RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_SHADER_RESOURCE, STATE_TRANSITION_FLAG_UPDATE_STATE},
+    };
+    // clang-format on
+    m_pImmediateContext->TransitionResourceStates(_countof(Barriers), Barriers);
+
+    FenceDesc FenceCI;
+    FenceCI.Name = "Frame resources fence";
+    FenceCI.Type = FENCE_TYPE_CPU_WAIT_ONLY;
+    m_pDevice->CreateFence(FenceCI, &m_pFrameFence);
+
+    // GPU timings of the scene require timestamp queries. Results are read back once the GPU
+    // has finished the frame, so every frame in flight needs its own queries.
+    if (m_pDevice->GetDeviceInfo().Features.TimestampQueries)
+    {
+        for (auto& pTimer : m_SceneGpuTimers)
+            pTimer = std::make_unique<DurationQueryHelper>(m_pDevice, MaxFramesInFlight + 1);
+        m_PrepassGpuTimer = std::make_unique<DurationQueryHelper>(m_pDevice, MaxFramesInFlight + 1);
+    }
 
     CreateInstanceBuffer();
-}
 
-static float angle = PI_F / 4;
+    if (!m_ReplayFilePath.empty())
+        m_FrameRecorder.LoadReplay(m_ReplayFilePath.c_str());
+    if (m_RecordOnStart)
+        m_FrameRecorder.StartRecording(m_RecordFilePath.c_str());
 
-void Tutorial04_Instancing::PopulateInstanceBuffer()
+    if (m_RunBenchmark)
+    {
+        if (m_BenchSettings.NumFrames == 0 && !m_FrameRecorder.IsReplaying())
+        {
+            LOG_WARNING_MESSAGE("Number of benchmark frames is not specified and there is no frame log to replay. Running 1000 frames.");
+            m_BenchSettings.NumFrames = 1000;
+        }
+        m_Benchmark.Start(m_BenchSettings);
+    }
+}
+
+void Tutorial04_Instancing::FinishBenchmark()
 {
-    // Populate instance data buffer
-    const auto            zGridSize = static_cast<size_t>(m_GridSize);
-    std::vector<float4x4> InstanceData(zGridSize * zGridSize * zGridSize);
+    // CPU microbenchmark of instance generation that excludes the upload and the GPU
+    std::vector<float4x4> InstanceData;
+    for (Uint32 i = 0; i < m_BenchSettings.NumMicroBenchIterations; ++i)
+    {
+        Timer GenTimer;
+        GenerateInstanceData(m_MobileAngle, *m_JobSystem, InstanceData);
+        m_Benchmark.AddMicroBenchSample("InstanceGeneration", GenTimer.GetElapsedTime() * 1000.0);
+    }
 
-    float fGridSize = static_cast<float>(m_GridSize);
+    // Scaling of instance generation from 1 to N threads
+    const Uint32        MaxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<Uint32> ThreadCounts;
+    for (Uint32 NumThreads = 1; NumThreads < MaxThreads; NumThreads *= 2)
+        ThreadCounts.push_back(NumThreads);
+    ThreadCounts.push_back(MaxThreads);
+    // The randomized grid must be identical regardless of the number of threads
+    std::vector<float4x4> GridData(static_cast<size_t>(ProceduralGrid::GetNumInstances(static_cast<Uint32>(m_GridSize))));
+    std::vector<float4x4> GridReference;
+    bool                  GridIsDeterministic = true;
+    for (const auto NumThreads : ThreadCounts)
+    {
+        JobSystem         Jobs{NumThreads - 1};
+        const std::string Metric = "InstanceGeneration.Threads" + std::to_string(NumThreads);
+        for (Uint32 i = 0; i < m_BenchSettings.NumMicroBenchIterations; ++i)
+        {
+            Timer GenTimer;
+            GenerateInstanceData(m_MobileAngle, Jobs, InstanceData);
+            m_Benchmark.AddMicroBenchSample(Metric.c_str(), GenTimer.GetElapsedTime() * 1000.0);
+        }
 
-    std::mt19937 gen; // Standard mersenne_twister_engine. Use default seed
-                      // to generate consistent distribution.
+        const std::string GridMetric = "GridGeneration.Threads" + std::to_string(NumThreads);
+        for (Uint32 i = 0; i < m_BenchSettings.NumMicroBenchIterations; ++i)
+        {
+            Timer GenTimer;
+            GenerateGridInstances(static_cast<Uint32>(m_GridSize), Jobs, GridData.data());
+            m_Benchmark.AddMicroBenchSample(GridMetric.c_str(), GenTimer.GetElapsedTime() * 1000.0);
+        }
+        if (GridReference.empty())
+        {
+            GridReference = GridData;
+        }
+        else if (std::memcmp(GridReference.data(), GridData.data(), GridData.size() * sizeof(GridData[0])) != 0)
+        {
+            LOG_ERROR_MESSAGE("Procedural grid generated with ", NumThreads, " threads differs from the single-threaded result");
+            GridIsDeterministic = false;
+        }
+    }
 
-    std::uniform_real_distribution<float> scale_distr(0.3f, 1.0f);
-    std::uniform_real_distribution<float> offset_distr(-0.15f, +0.15f);
-    std::uniform_real_distribution<float> rot_distr(-PI_F, +PI_F);
+#if T4_DRAW_VALIDATION_ENABLED
+    // CPU cost of recording the scene with every validation level. The difference between
+    // the levels is the overhead that release builds do not have.
+    {
+        static constexpr const Char* LevelNames[DRAW_VALIDATION_COUNT] = {"None", "States", "Full"};
 
-    float BaseScale = 0.6f / fGridSize;
-    int   instId    = 0;
+        // The scene is recorded with the same targets as in Render()
+        auto*     pRTV           = m_pSwapChain->GetCurrentBackBufferRTV();
+        auto*     pDSV           = m_SceneDepthDSV ? m_SceneDepthDSV.RawPtr() : m_pSwapChain->GetDepthBufferDSV();
+        const int DrawValidation = m_DrawValidation;
 
-    // Figuras en el Mobil
+        // RenderScene adds GPU timings that would be mixed with the ones of the measured frames
+        m_Benchmark.SetFrameSamplesPaused(true);
 
-    angle += 0.01;
+        double TotalTime[DRAW_VALIDATION_COUNT] = {};
+        for (Uint32 i = 0; i < m_BenchSettings.NumMicroBenchIterations; ++i)
+        {
+            for (int Level = 0; Level < DRAW_VALIDATION_COUNT; ++Level)
+            {
+                m_DrawValidation = Level;
+                Timer RecordTimer;
+                RenderScene(pRTV, pDSV);
+                const double RecordTime = RecordTimer.GetElapsedTime() * 1000.0;
+                m_Benchmark.AddMicroBenchSample((std::string{"RenderScene.Validation"} + LevelNames[Level]).c_str(), RecordTime);
+                TotalTime[Level] += RecordTime;
+                m_pImmediateContext->Flush();
+            }
+        }
+        m_DrawValidation = DrawValidation;
+        m_Benchmark.SetFrameSamplesPaused(false);
 
-    float4x4 matrix        = float4x4::Scale(0.7, 0.7, 0.7) * float4x4::Translation(0, 4, 0) * float4x4::RotationY(angle); // Center lv 1
-    InstanceData[instId++] = matrix;
+        const double NumIterations = static_cast<double>(std::max(m_BenchSettings.NumMicroBenchIterations, 1u));
+        LOG_INFO_MESSAGE("Draw validation overhead: ", (TotalTime[DRAW_VALIDATION_FULL] - TotalTime[DRAW_VALIDATION_NONE]) / NumIterations, " ms per frame");
+    }
+#endif
+
+    const bool Passed = m_Benchmark.Finish() && GridIsDeterministic;
+    if (Passed)
+        LOG_INFO_MESSAGE("Benchmark PASSED");
+    else
+        LOG_ERROR_MESSAGE("Benchmark FAILED");
+
+    // The benchmark may finish in the middle of a frame, so the process exits at the
+    // beginning of the next one
+    m_BenchmarkFinished = true;
+    m_BenchmarkExitCode = Passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-    matrix                 = float4x4::Scale(0.6, 0.6, 0.6) * float4x4::Translation(6, 6, 0) * float4x4::RotationY(angle); // Right lv 1
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::ExitAfterBenchmark()
+{
+    // The sample framework does not provide a way to request shutdown, so everything that
+    // would otherwise be torn down by the destructors is shut down here: the GPU must be done with
+    // the resources, the worker threads must be joined and the outputs must be complete.
+    m_pImmediateContext->Flush();
+    m_pImmediateContext->WaitForIdle();
+    m_Simulation.reset();
+    m_JobSystem.reset();
+
+    m_FrameRecorder.StopRecording();
+    Profiler::RemoveSink(&m_Trace);
+    Profiler::RemoveSink(&m_ProfilerOverlay);
+    if (m_Trace.IsEnabled() && m_Trace.GetNumEvents() > 0)
+        m_Trace.WriteChromeTrace(m_TraceFilePath.c_str());
+
+    std::exit(m_BenchmarkExitCode);
+}
 
-    matrix                 = float4x4::Scale(0.6, 0.6, 0.6) * float4x4::Translation(-6, 6, 0) * float4x4::RotationY(angle); // Left lv 1
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::GenerateMobileInstances(float Angle, JobSystem& Jobs, float4x4* pDst) const
+{
+    // Every job expands a range of mobiles into their parts
+    const Uint64 MobilesPerChunk = std::max(InstanceGenChunkSize / MobileTemplate::NumParts, Uint64{1});
+    Jobs.ParallelFor(m_Placements.size(), MobilesPerChunk, [&](Uint64 Begin, Uint64 End) {
+        MobileTemplate::ExpandInstances(m_Placements.data(), Angle, Begin, End, pDst + Begin * MobileTemplate::NumParts);
+    });
+}
 
-    matrix                 = float4x4::Scale(0.6, 0.6, 0.6) * float4x4::Translation(0, 6, 6) * float4x4::RotationY(angle); // Front lv 1
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::GenerateGridInstances(Uint32 GridSize, JobSystem& Jobs, float4x4* pDst)
+{
+    // Instances are generated in chunks on all cores
+    Jobs.ParallelFor(ProceduralGrid::GetNumInstances(GridSize), InstanceGenChunkSize, [&](Uint64 Begin, Uint64 End) {
+        ProceduralGrid::GenerateInstances(GridSize, ProceduralGrid::DefaultSeed, GridStressExtent, Begin, End, pDst + Begin);
+    });
+}
 
-    matrix                 = float4x4::Scale(0.6, 0.6, 0.6) * float4x4::Translation(0, 6, -6) * float4x4::RotationY(angle); // Back lv 1
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::GeneratePlacements()
+{
+    const Uint32 NumMobiles = GetSceneNumMobiles();
+    m_Placements.resize(NumMobiles);
+    if (m_SceneMode == SCENE_MODE_MANY_MOBILES)
+        MobileTemplate::GeneratePlacements(NumMobiles, MobileSpacing, MobileLayoutSeed, 0, NumMobiles, m_Placements.data());
+    else
+        m_Placements[0] = MobilePlacement{}; // The mobile of the original scene
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(6, 3, 0) * float4x4::RotationY(angle); // Right lv 2
-    InstanceData[instId++] = matrix;
+Uint32 Tutorial04_Instancing::GetSceneGridSize() const
+{
+    return m_SceneMode == SCENE_MODE_GRID_STRESS ? static_cast<Uint32>(m_GridSize) : 0;
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(-6, 3, 0) * float4x4::RotationY(angle); // Left lv 2
-    InstanceData[instId++] = matrix;
+Uint32 Tutorial04_Instancing::GetSceneNumMobiles() const
+{
+    return m_SceneMode == SCENE_MODE_MANY_MOBILES ? static_cast<Uint32>(m_NumMobiles) : 1;
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(0, 3, 6) * float4x4::RotationY(angle); // Front lv 2
-    InstanceData[instId++] = matrix;
+size_t Tutorial04_Instancing::GetNumCPUMobileInstances() const
+{
+    // Unless mobile parts are expanded into matrices on the CPU, the instance data only contains the grid
+    return m_MobileInstancing == MOBILE_INSTANCING_CPU_MATRICES ? m_Placements.size() * MobileTemplate::NumParts : 0;
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(0, 3, -6) * float4x4::RotationY(angle); // Back lv 2
-    InstanceData[instId++] = matrix;
+Tutorial04_Instancing::SceneLayout Tutorial04_Instancing::GetSceneLayout() const
+{
+    SceneLayout Layout;
+    Layout.SceneMode        = m_SceneMode;
+    Layout.GridSize         = GetSceneGridSize();
+    Layout.NumMobiles       = GetSceneNumMobiles();
+    Layout.MobileInstancing = m_MobileInstancing;
+    return Layout;
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(6, 0, 0) * float4x4::RotationY(angle); // Right lv 3
-    InstanceData[instId++] = matrix;
+float Tutorial04_Instancing::GetSceneExtent() const
+{
+    switch (m_SceneMode)
+    {
+        case SCENE_MODE_GRID_STRESS:
+            return GridStressExtent;
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(-6, 0, 0) * float4x4::RotationY(angle); // Left lv 3
-    InstanceData[instId++] = matrix;
+        case SCENE_MODE_MANY_MOBILES:
+            return 0.5f * static_cast<float>(MobileTemplate::GetLayoutSide(GetSceneNumMobiles())) * MobileSpacing;
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(0, 0, 6) * float4x4::RotationY(angle); // Front lv 3
-    InstanceData[instId++] = matrix;
+        default:
+            return 0;
+    }
+}
 
-    matrix                 = float4x4::Scale(0.5, 0.5, 0.5) * float4x4::Translation(0, 0, -6) * float4x4::RotationY(angle); // Back lv 3
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::GenerateInstanceData(float Angle, JobSystem& Jobs, std::vector<float4x4>& InstanceData) const
+{
+    // Mobile parts go first and are followed by the grid instances
+    const Uint32 GridSize           = GetSceneGridSize();
+    const size_t NumMobileInstances = GetNumCPUMobileInstances();
+    InstanceData.resize(NumMobileInstances + static_cast<size_t>(ProceduralGrid::GetNumInstances(GridSize)));
+    // Release memory of the staging data once the scene became much smaller
+    if (InstanceData.capacity() > InstanceData.size() * 4)
+        InstanceData.shrink_to_fit();
+
+    if (NumMobileInstances > 0)
+        GenerateMobileInstances(Angle, Jobs, InstanceData.data());
+    if (GridSize > 0)
+        GenerateGridInstances(GridSize, Jobs, InstanceData.data() + NumMobileInstances);
+}
 
+void Tutorial04_Instancing::PopulateInstanceBuffer(double CurrTime)
+{
+    T4_PROFILE_ZONE("PopulateInstanceBuffer");
+
+    // The mobiles are animated on the simulation thread. Request the state at the current time and
+    // use the most recent snapshot, which normally is the one requested in the previous frame.
+    // Replays and benchmarks must produce the same frames regardless of the thread timing,
+    // so they wait for the state at the current time.
+    m_Simulation->SetAnimate(m_AnimateMobile);
+    const Uint64 KickIndex = m_Simulation->Kick(CurrTime);
+    if (m_FrameRecorder.IsReplaying() || m_Benchmark.IsRunning())
+        m_Simulation->WaitForSnapshot(KickIndex);
+    const auto& Snapshot = m_Simulation->AcquireSnapshot();
+    if (Snapshot.Version != 0)
+        m_MobileAngle = Snapshot.Angle;
+    // The angle of a recorded frame depended on the timing of the recorded session, so replays use it directly
+    if (m_UseReplayMobileAngle)
+        m_MobileAngle = m_ReplayMobileAngle;
+
+    // Placements and the grid are static, so they are only regenerated when the scene layout changes
+    const SceneLayout Layout        = GetSceneLayout();
+    const bool        LayoutChanged = Layout != m_GeneratedLayout;
+    {
+        T4_PROFILE_ZONE("GenerateInstanceData");
+        if (LayoutChanged)
+        {
+            GeneratePlacements();
+            GenerateInstanceData(m_MobileAngle, *m_JobSystem, m_InstanceData);
+            m_PlacementBuffer.Release();
+            m_StaticInstanceStream.Release();
+            m_DynamicInstanceStream.Release();
+            if (m_MobileInstancing == MOBILE_INSTANCING_GPU_TEMPLATE)
+                CreatePlacementBuffer();
+            else if (m_MobileInstancing == MOBILE_INSTANCING_SPLIT_STREAMS)
+                CreateSplitInstanceStreams();
+            m_GeneratedLayout  = Layout;
+            m_LayoutGeneration = ++m_InstanceDataGeneration;
+            m_Simulation->SetLayout(m_Placements, m_MobileInstancing == MOBILE_INSTANCING_CPU_MATRICES, m_LayoutGeneration);
+        }
+        else if (m_MobileInstancing == MOBILE_INSTANCING_CPU_MATRICES && m_MobileAngle != m_GeneratedAngle)
+        {
+            // Mobile instances only depend on the angle and don't change while the animation is paused.
+            // They are expanded by the simulation thread, unless the snapshot predates the layout.
+            if (Snapshot.LayoutVersion == m_LayoutGeneration && Snapshot.Instances.size() == GetNumCPUMobileInstances() && Snapshot.Angle == m_MobileAngle)
+                std::copy(Snapshot.Instances.begin(), Snapshot.Instances.end(), m_InstanceData.begin());
+            else
+                GenerateMobileInstances(m_MobileAngle, *m_JobSystem, m_InstanceData.data());
+            ++m_InstanceDataGeneration;
+        }
+        m_GeneratedAngle = m_MobileAngle;
+    }
 
-    // Tubos
+    if (m_DynamicInstanceStream)
+        UpdateDynamicInstanceStream();
+
+    // Update instance data buffer of this frame
+    T4_PROFILE_ZONE("UploadInstances");
+    auto&      Res             = AcquireFrameResources();
+    const bool BufferRecreated = ReserveInstanceBuffer(Res, m_InstanceData.size());
+    if (!Res.pInstanceBuffer)
+        return;
+
+    // Skip the upload entirely if the buffer already contains this generation of the instance data
+    const bool IsUpToDate = !BufferRecreated && Res.UploadedGeneration == m_InstanceDataGeneration;
+    ++m_NumUploadChecks;
+    if (IsUpToDate)
+        ++m_NumSkippedUploads;
+    T4_PROFILE_COUNTER("InstanceUploadSkipPercent", 100.0 * static_cast<double>(m_NumSkippedUploads) / static_cast<double>(m_NumUploadChecks));
+    if (IsUpToDate)
+        return;
+
+    // Only the animated mobiles are uploaded, unless the buffer is new or contains a different layout.
+    // Every frame in flight has its own buffer, so the layout is tracked per buffer.
+    const bool FullUpload  = BufferRecreated || Res.UploadedLayout != m_LayoutGeneration;
+    Res.UploadedGeneration = m_InstanceDataGeneration;
+    Res.UploadedLayout     = m_LayoutGeneration;
+
+    const size_t NumUploadInstances = FullUpload ? m_InstanceData.size() : GetNumCPUMobileInstances();
+    if (NumUploadInstances == 0)
+        return;
+
+    const Uint64 DataSize = sizeof(m_InstanceData[0]) * NumUploadInstances;
+    m_pImmediateContext->UpdateBuffer(Res.pInstanceBuffer, 0, DataSize, m_InstanceData.data(), RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    // The update leaves the buffer in the copy destination state
+    TransitionBufferState(Res.pInstanceBuffer, Res.IsStructured ? RESOURCE_STATE_SHADER_RESOURCE : RESOURCE_STATE_VERTEX_BUFFER);
+    T4_PROFILE_COUNTER("InstanceUploadBytes", DataSize);
+}
 
-    matrix = float4x4::Scale(6, 0.08, 0.08) * float4x4::Translation(0, 8, 0) * float4x4::RotationY(angle); // Center lv 1
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::UpdateInstanceOrder()
+{
+    auto& Res = m_FrameResources[m_FrameResIndex];
+    if (!m_DepthSort || !Res.pOrderBuffer || m_InstanceData.empty())
+        return;
 
-    matrix                 = float4x4::Scale(0.08, 0.08, 6) * float4x4::Translation(0, 8, 0) * float4x4::RotationY(angle); // Center lv 1
-    InstanceData[instId++] = matrix;
+    // Animated instances move only slightly between frames, so the order is reused while the camera
+    // is still. A stale order only makes early depth testing less effective.
+    if (m_SortedLayout != m_LayoutGeneration || m_SortedViewProj != m_ViewProjMatrix)
+    {
+        T4_PROFILE_ZONE("DepthSort");
+        m_DepthSorter.Sort(m_InstanceData.data(), m_InstanceData.size(), m_ViewProjMatrix);
+        m_SortedLayout   = m_LayoutGeneration;
+        m_SortedViewProj = m_ViewProjMatrix;
+        ++m_OrderGeneration;
+    }
 
-    //Palos para abajos
+    // Every frame in flight has its own order buffer
+    if (Res.UploadedOrder == m_OrderGeneration)
+        return;
 
-    matrix                 = float4x4::Scale(0.08, 2, 0.08) * float4x4::Translation(0, 6, 0) * float4x4::RotationY(angle);
-    InstanceData[instId++] = matrix;
+    const auto&  Order    = m_DepthSorter.GetOrder();
+    const Uint64 DataSize = sizeof(Order[0]) * Order.size();
+    m_pImmediateContext->UpdateBuffer(Res.pOrderBuffer, 0, DataSize, Order.data(), RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    TransitionBufferState(Res.pOrderBuffer, RESOURCE_STATE_SHADER_RESOURCE);
+    Res.UploadedOrder = m_OrderGeneration;
+    T4_PROFILE_COUNTER("InstanceOrderBytes", DataSize);
+}
 
-    matrix                 = float4x4::Scale(0.08, 4, 0.08) * float4x4::Translation(6, 4, 0) * float4x4::RotationY(angle);
-    InstanceData[instId++] = matrix;
 
-    matrix                 = float4x4::Scale(0.08, 4, 0.08) * float4x4::Translation(0, 4, 6) * float4x4::RotationY(angle);
-    InstanceData[instId++] = matrix;
+DRAW_FLAGS Tutorial04_Instancing::GetDrawFlags() const
+{
+#if T4_DRAW_VALIDATION_ENABLED
+    if (m_DrawValidation == DRAW_VALIDATION_FULL)
+        return DRAW_FLAG_VERIFY_ALL;
+#endif
+    return DRAW_FLAG_NONE;
+}
 
-    matrix                 = float4x4::Scale(0.08, 4, 0.08) * float4x4::Translation(-6, 4, 0) * float4x4::RotationY(angle);
-    InstanceData[instId++] = matrix;
+RESOURCE_STATE_TRANSITION_MODE Tutorial04_Instancing::GetStateTransitionMode() const
+{
+    // All resources are already in the required states, so the states are at most verified
+#if T4_DRAW_VALIDATION_ENABLED
+    if (m_DrawValidation != DRAW_VALIDATION_NONE)
+        return RESOURCE_STATE_TRANSITION_MODE_VERIFY;
+#endif
+    return RESOURCE_STATE_TRANSITION_MODE_NONE;
+}
 
-    matrix                 = float4x4::Scale(0.08, 4, 0.08) * float4x4::Translation(0, 4, -6) * float4x4::RotationY(angle);
-    InstanceData[instId++] = matrix;
+void Tutorial04_Instancing::BuildDrawPackets(FrameResources& Res)
+{
+    T4_PROFILE_ZONE("BuildDrawPackets");
+    Res.DrawPackets.clear();
 
-    // Update instance data buffer
-    Uint32 DataSize = static_cast<Uint32>(sizeof(InstanceData[0]) * InstanceData.size());
-    m_pImmediateContext->UpdateBuffer(m_InstanceBuffer, 0, DataSize, InstanceData.data(), RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
-}
+    const Uint32 NumMobileInstances = static_cast<Uint32>(m_Placements.size() * MobileTemplate::NumParts);
+    if (m_MobileInstancing == MOBILE_INSTANCING_GPU_TEMPLATE && m_PlacementBuffer)
+    {
+        // Vertex and placement buffers. Every mobile is drawn as NumParts consecutive instances.
+        DrawPacket Packet;
+        Packet.PSOs             = {m_pMobilePSO, m_MobilePrepass.pDepthPSO, m_MobilePrepass.pEqualPSO};
+        Packet.SRBs             = {m_MobileSRB, m_MobilePrepass.pDepthSRB, m_MobileSRB};
+        Packet.VertexBuffers    = {m_CubeVertexBuffer, m_PlacementBuffer};
+        Packet.NumVertexBuffers = 2;
+        Packet.NumInstances     = NumMobileInstances;
+        Res.DrawPackets.push_back(Packet);
+    }
+    else if (m_MobileInstancing == MOBILE_INSTANCING_SPLIT_STREAMS && m_StaticInstanceStream && m_DynamicInstanceStream)
+    {
+        // Vertex buffer and both instance streams
+        DrawPacket Packet;
+        Packet.PSOs             = {m_pSplitPSO, m_SplitPrepass.pDepthPSO, m_SplitPrepass.pEqualPSO};
+        Packet.SRBs             = {m_SplitSRB, m_SplitPrepass.pDepthSRB, m_SplitSRB};
+        Packet.VertexBuffers    = {m_CubeVertexBuffer, m_StaticInstanceStream, m_DynamicInstanceStream};
+        Packet.NumVertexBuffers = 3;
+        Packet.NumInstances     = NumMobileInstances;
+        Res.DrawPackets.push_back(Packet);
+    }
 
+    const Uint32 NumInstances = static_cast<Uint32>(m_InstanceData.size());
+    // Instances are drawn through the order buffer when they are sorted front to back, or through
+    // the visible instances written by the culling pass
+    Res.DrawPacketsSorted = m_DepthSort && Res.pSortedPullSRB;
+    Res.DrawPacketsCulled = UseOcclusionCulling(Res);
+    if (NumInstances != 0 && Res.pInstanceBuffer && Res.IsStructured)
+    {
+        // Instance data is read by the vertex shader from the structured buffer
+        DrawPacket Packet;
+        if (Res.DrawPacketsCulled)
+        {
+            Packet.PSOs          = {m_pPullIndexedPSO, m_PullIndexedPrepass.pDepthPSO, m_PullIndexedPrepass.pEqualPSO};
+            Packet.SRBs          = {Res.pCulledPullSRB, Res.pCulledPullDepthSRB, Res.pCulledPullSRB};
+            Packet.pIndirectArgs = Res.pDrawArgsBuffer;
+        }
+        else if (Res.DrawPacketsSorted)
+        {
+            Packet.PSOs = {m_pPullIndexedPSO, m_PullIndexedPrepass.pDepthPSO, m_PullIndexedPrepass.pEqualPSO};
+            Packet.SRBs = {Res.pSortedPullSRB, Res.pSortedPullDepthSRB, Res.pSortedPullSRB};
+        }
+        else
+        {
+            Packet.PSOs = {m_pPullPSO, m_PullPrepass.pDepthPSO, m_PullPrepass.pEqualPSO};
+            Packet.SRBs = {Res.pPullSRB, Res.pPullDepthSRB, Res.pPullSRB};
+        }
+        Packet.VertexBuffers    = {m_CubeVertexBuffer};
+        Packet.NumVertexBuffers = 1;
+        Packet.NumInstances     = NumInstances;
+        Res.DrawPackets.push_back(Packet);
+    }
+    else if (NumInstances != 0 && Res.pInstanceBuffer)
+    {
+        // Vertex and instance buffers
+        DrawPacket Packet;
+        Packet.PSOs             = {m_pPSO, m_Prepass.pDepthPSO, m_Prepass.pEqualPSO};
+        Packet.SRBs             = {m_SRB, m_Prepass.pDepthSRB, m_SRB};
+        Packet.VertexBuffers    = {m_CubeVertexBuffer, Res.pInstanceBuffer};
+        Packet.NumVertexBuffers = 2;
+        Packet.NumInstances     = NumInstances;
+        Res.DrawPackets.push_back(Packet);
+    }
 
-// Render a frame
-void Tutorial04_Instancing::Render()
+    Res.DrawPacketsLayout = m_LayoutGeneration;
+    Res.DrawPacketsDirty  = false;
+    T4_PROFILE_COUNTER("DrawPackets", Res.DrawPackets.size());
+}
+
+void Tutorial04_Instancing::RenderScene(ITextureView* pRTV, ITextureView* pDSV)
 {
-    auto* pRTV = m_pSwapChain->GetCurrentBackBufferRTV();
-    auto* pDSV = m_pSwapChain->GetDepthBufferDSV();
-    // Clear the back buffer
+    const auto StateMode = GetStateTransitionMode();
+
+    // Write the constants that have changed since the last frame
+    UpdateConstantBuffers();
+
+    // Occluded instances are rejected against the depth of the previous frame before the
+    // render targets are bound
+    auto& Res = m_FrameResources[m_FrameResIndex];
+    if (UseOcclusionCulling(Res) && !m_InstanceData.empty())
+        CullInstances(Res);
+
+    // The swap chain transitions the back buffer for presentation, so render targets are
+    // the only resources whose states change every frame
+    m_pImmediateContext->SetRenderTargets(1, &pRTV, pDSV, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+
+    // Clear the render target
     float4 ClearColor = {0.350f, 0.350f, 0.350f, 1.0f};
     if (m_ConvertPSOutputToGamma)
     {
         // If manual gamma correction is required, we need to clear the render target with sRGB color
         ClearColor = LinearToSRGB(ClearColor);
     }
-    m_pImmediateContext->ClearRenderTarget(pRTV, ClearColor.Data(), RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
-    m_pImmediateContext->ClearDepthStencil(pDSV, CLEAR_DEPTH_FLAG, 1.f, 0, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    m_pImmediateContext->ClearRenderTarget(pRTV, ClearColor.Data(), StateMode);
+    m_pImmediateContext->ClearDepthStencil(pDSV, CLEAR_DEPTH_FLAG, 1.f, 0, StateMode);
+
+    m_pImmediateContext->SetIndexBuffer(m_CubeIndexBuffer, 0, StateMode);
+
+    DrawIndexedAttribs DrawAttrs;     // This is an indexed draw call
+    DrawAttrs.IndexType  = VT_UINT32; // Index type
+    DrawAttrs.NumIndices = 36;
+    // Verify the state of vertex and index buffers unless validation is disabled
+    DrawAttrs.Flags = GetDrawFlags();
+
+    // The draw sequence is only rebuilt when buffers or pipelines change
+    if (Res.DrawPacketsDirty || Res.DrawPacketsLayout != m_LayoutGeneration ||
+        Res.DrawPacketsSorted != (m_DepthSort && Res.pSortedPullSRB) || Res.DrawPacketsCulled != UseOcclusionCulling(Res))
+        BuildDrawPackets(Res);
+
+    T4_PROFILE_ZONE("SubmitDraws");
+
+    // Every mode has its own GPU timer
+    const int Mode           = m_DepthPrepass ? 1 : 0;
+    auto*     pSceneGpuTimer = m_SceneGpuTimers[Mode].get();
+    if (pSceneGpuTimer)
+        pSceneGpuTimer->Begin(m_pImmediateContext);
+
+    Timer  SubmitTimer;
+    Uint32 NumInstances = 0;
+    if (m_DepthPrepass)
+    {
+        // Fill the depth buffer first, so that the color pass only shades the closest fragments.
+        // The pre-pass pipelines have no render targets. Both targets are already in the required states.
+        m_pImmediateContext->SetRenderTargets(0, nullptr, pDSV, StateMode);
+        if (m_PrepassGpuTimer)
+            m_PrepassGpuTimer->Begin(m_pImmediateContext);
+        SubmitDrawPackets(Res, CUBE_PASS_DEPTH_ONLY, DrawAttrs, StateMode);
+        if (m_PrepassGpuTimer && m_PrepassGpuTimer->End(m_pImmediateContext, m_PrepassGpuTime))
+        {
+            m_Benchmark.AddSample("GpuDepthPrepass", m_PrepassGpuTime * 1000.0);
+            T4_PROFILE_COUNTER("GpuDepthPrepassMs", m_PrepassGpuTime * 1000.0);
+        }
+
+        m_pImmediateContext->SetRenderTargets(1, &pRTV, pDSV, StateMode);
+        NumInstances = SubmitDrawPackets(Res, CUBE_PASS_DEPTH_EQUAL, DrawAttrs, StateMode);
+    }
+    else
+    {
+        NumInstances = SubmitDrawPackets(Res, CUBE_PASS_COLOR, DrawAttrs, StateMode);
+    }
+    m_SubmitTime = SubmitTimer.GetElapsedTime();
+
+    // Query results arrive a few frames later
+    if (pSceneGpuTimer && pSceneGpuTimer->End(m_pImmediateContext, m_SceneGpuTime[Mode]))
+    {
+        m_Benchmark.AddSample("GpuScene", m_SceneGpuTime[Mode] * 1000.0);
+        T4_PROFILE_COUNTER("GpuSceneMs", m_SceneGpuTime[Mode] * 1000.0);
+    }
+    T4_PROFILE_COUNTER("Instances", NumInstances);
+
+    // The next frame is culled against the depth of this one
+    if (m_HiZ)
+        BuildHiZ(pDSV);
+}
+
+void Tutorial04_Instancing::CullInstances(FrameResources& Res)
+{
+    T4_PROFILE_ZONE("CullInstances");
+
+    const auto& NDCAttribs = m_pDevice->GetDeviceInfo().GetNDCAttribs();
+    const auto& DepthDesc  = m_SceneDepthDSV->GetTexture()->GetDesc();
+
+    CullConstants Constants;
+    Constants.ViewProj     = m_ViewProjMatrix;
+    Constants.HiZViewProj  = m_HiZViewProj;
+    Constants.NDCAttribs   = float4{NDCAttribs.MinZ, NDCAttribs.ZtoDepthScale, NDCAttribs.YtoVScale, 0};
+    Constants.DepthSize    = float2{static_cast<float>(DepthDesc.Width), static_cast<float>(DepthDesc.Height)};
+    Constants.HiZMipLevels = static_cast<Uint32>(m_HiZMipSRVs.size());
+    // Instances of a different layout have never been rendered into the Hi-Z buffer, and after the camera
+    // has moved, instances that were hidden in the previous view may be visible. Such a frame would
+    // also stay in the idle mode frame cache, so occlusion culling only runs while the view is unchanged.
+    Constants.HiZValid     = m_HiZValid && m_HiZLayout == m_LayoutGeneration && m_HiZViewProj == m_ViewProjMatrix ? 1 : 0;
+    Constants.NumInstances = static_cast<Uint32>(m_InstanceData.size());
+    // Instances are tested in the front-to-back order when it is up to date. The visible instances are
+    // appended with atomics, so the order of the draw is only roughly front to back.
+    Constants.UseOrder = m_DepthSort && Res.UploadedOrder == m_OrderGeneration ? 1 : 0;
+    UpdateConstantBuffer(m_CullConstants, &Constants, sizeof(Constants));
+
+    // The culling pass adds every visible instance to the instance count
+    m_pImmediateContext->UpdateBuffer(Res.pDrawArgsBuffer, 0, sizeof(CulledDrawArgs), CulledDrawArgs, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+
+    // clang-format off
+    StateTransitionDesc Barriers[] =
+    {
+        {Res.pDrawArgsBuffer, RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_UNORDERED_ACCESS, STATE_TRANSITION_FLAG_UPDATE_STATE},
+        {Res.pVisibleBuffer,  RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_UNORDERED_ACCESS, STATE_TRANSITION_FLAG_UPDATE_STATE}
+    };
+    // clang-format on
+    m_pImmediateContext->TransitionResourceStates(_countof(Barriers), Barriers);
+
+    m_pImmediateContext->SetPipelineState(m_pCullPSO);
+    Res.pCullSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_HiZ")->Set(m_HiZ->GetDefaultView(TEXTURE_VIEW_SHADER_RESOURCE));
+    m_pImmediateContext->CommitShaderResources(Res.pCullSRB, GetStateTransitionMode());
+
+    DispatchComputeAttribs DispatchAttrs{(Constants.NumInstances + 63) / 64, 1, 1};
+    m_pImmediateContext->DispatchCompute(DispatchAttrs);
+
+    // The counts are read back once the GPU has finished the frame
+    m_pImmediateContext->CopyBuffer(Res.pDrawArgsBuffer, 0, RESOURCE_STATE_TRANSITION_MODE_TRANSITION,
+                                    Res.pDrawArgsReadback, 0, sizeof(CulledDrawArgs), RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    Res.NumCullTestedInstances = Constants.NumInstances;
+    Res.CullStatsPending       = true;
+
+    TransitionBufferState(Res.pDrawArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT);
+    TransitionBufferState(Res.pVisibleBuffer, RESOURCE_STATE_SHADER_RESOURCE);
+}
+
+void Tutorial04_Instancing::BuildHiZ(ITextureView* pDSV)
+{
+    T4_PROFILE_ZONE("BuildHiZ");
+
+    auto* pDepthSRV = pDSV->GetTexture()->GetDefaultView(TEXTURE_VIEW_SHADER_RESOURCE);
+    if (pDepthSRV == nullptr)
+    {
+        // The depth buffer can't be read by shaders
+        m_HiZValid = false;
+        return;
+    }
+
+    // clang-format off
+    StateTransitionDesc Barriers[] =
+    {
+        {pDSV->GetTexture(), RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_SHADER_RESOURCE,  STATE_TRANSITION_FLAG_UPDATE_STATE},
+        {m_HiZ,              RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_UNORDERED_ACCESS, STATE_TRANSITION_FLAG_UPDATE_STATE}
+    };
+    // clang-format on
+    m_pImmediateContext->TransitionResourceStates(_countof(Barriers), Barriers);
+    m_pImmediateContext->SetPipelineState(m_pHiZBuildPSO);
+
+    const auto&  HiZDesc   = m_HiZ->GetDesc();
+    const Uint32 MipLevels = static_cast<Uint32>(m_HiZMipUAVs.size());
+    for (Uint32 Mip = 0; Mip < MipLevels; ++Mip)
+    {
+        if (Mip > 0)
+        {
+            // The previous level is read while this one is written, so the levels are transitioned individually
+            StateTransitionDesc Barrier{m_HiZ, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE, Mip - 1, 1, 0, REMAINING_ARRAY_SLICES};
+            m_pImmediateContext->TransitionResourceStates(1, &Barrier);
+        }
+        m_HiZBuildSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_SrcDepth")->Set(Mip > 0 ? m_HiZMipSRVs[Mip - 1].RawPtr() : pDepthSRV);
+        m_HiZBuildSRB->GetVariableByName(SHADER_TYPE_COMPUTE, "g_DstDepth")->Set(m_HiZMipUAVs[Mip]);
+        // Barriers above are explicit, so the states are only verified by the validation layer
+        m_pImmediateContext->CommitShaderResources(m_HiZBuildSRB, RESOURCE_STATE_TRANSITION_MODE_NONE);
+
+        const Uint32 Width  = std::max(HiZDesc.Width >> Mip, 1u);
+        const Uint32 Height = std::max(HiZDesc.Height >> Mip, 1u);
+
+        DispatchComputeAttribs DispatchAttrs{(Width + 7) / 8, (Height + 7) / 8, 1};
+        m_pImmediateContext->DispatchCompute(DispatchAttrs);
+    }
+
+    // The whole chain is read by the culling pass of the next frame
+    StateTransitionDesc Barrier{m_HiZ, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE, MipLevels - 1, 1, 0, REMAINING_ARRAY_SLICES};
+    m_pImmediateContext->TransitionResourceStates(1, &Barrier);
+    m_HiZ->SetState(RESOURCE_STATE_SHADER_RESOURCE);
+
+    m_HiZViewProj = m_ViewProjMatrix;
+    m_HiZLayout   = m_LayoutGeneration;
+    m_HiZValid    = true;
+}
+
+void Tutorial04_Instancing::ReadCullingStats(FrameResources& Res)
+{
+    Res.CullStatsPending = false;
+
+    // The fence of the frame has been reached, so the copy has completed
+    MapHelper<Uint32> DrawArgs{m_pImmediateContext, Res.pDrawArgsReadback, MAP_READ, MAP_FLAG_DO_NOT_WAIT};
+    if (!DrawArgs)
+        return;
+
+    m_NumTestedInstances  = Res.NumCullTestedInstances;
+    m_NumVisibleInstances = std::min(DrawArgs[1], Res.NumCullTestedInstances);
+    m_NumCulledInstances  = Res.NumCullTestedInstances - m_NumVisibleInstances;
+    T4_PROFILE_COUNTER("VisibleInstances", m_NumVisibleInstances);
+    T4_PROFILE_COUNTER("CulledInstances", m_NumCulledInstances);
+}
+
+Uint32 Tutorial04_Instancing::SubmitDrawPackets(const FrameResources& Res, CUBE_PASS Pass, DrawIndexedAttribs& DrawAttrs, RESOURCE_STATE_TRANSITION_MODE StateMode)
+{
+    const Uint64 Offsets[DrawPacket::MaxVertexBuffers] = {};
+    Uint32       NumInstances                          = 0;
+    for (const auto& Packet : Res.DrawPackets)
+    {
+        m_pImmediateContext->SetVertexBuffers(0, Packet.NumVertexBuffers, Packet.VertexBuffers.data(), Offsets, StateMode, SET_VERTEX_BUFFERS_FLAG_RESET);
+        m_pImmediateContext->SetPipelineState(Packet.PSOs[Pass]);
+        // Commit shader resources. All resources are already in the required states,
+        // so they are only verified, depending on the validation level.
+        m_pImmediateContext->CommitShaderResources(Packet.SRBs[Pass], StateMode);
+
+        if (Packet.pIndirectArgs != nullptr)
+        {
+            // The number of instances is written by the culling pass
+            DrawIndexedIndirectAttribs IndirectAttrs;
+            IndirectAttrs.IndexType                        = DrawAttrs.IndexType;
+            IndirectAttrs.pAttribsBuffer                   = Packet.pIndirectArgs;
+            IndirectAttrs.Flags                            = DrawAttrs.Flags;
+            IndirectAttrs.AttribsBufferStateTransitionMode = StateMode;
+            m_pImmediateContext->DrawIndexedIndirect(IndirectAttrs);
+        }
+        else
+        {
+            DrawAttrs.NumInstances = Packet.NumInstances; // The number of instances
+            m_pImmediateContext->DrawIndexed(DrawAttrs);
+        }
+        // The number of instances drawn indirectly is only known once the counts of a culled frame
+        // are read back, so the count of the most recent one is reported
+        NumInstances += Packet.pIndirectArgs != nullptr ? m_NumVisibleInstances : Packet.NumInstances;
+    }
+    return NumInstances;
+}
+
+void Tutorial04_Instancing::BlitFrameCache(ITextureView* pRTV)
+{
+    T4_PROFILE_ZONE("BlitFrameCache");
 
+    m_pImmediateContext->SetRenderTargets(1, &pRTV, nullptr, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    m_pImmediateContext->SetPipelineState(m_pBlitPSO);
+    m_pImmediateContext->CommitShaderResources(m_BlitSRB, GetStateTransitionMode());
+
+    DrawAttribs DrawAttrs{3, GetDrawFlags()};
+    m_pImmediateContext->Draw(DrawAttrs);
+}
+
+// Render a frame
+void Tutorial04_Instancing::Render()
+{
+    T4_PROFILE_ZONE_BEGIN("Render");
+    Timer RenderTimer;
+
+    auto* pRTV = m_pSwapChain->GetCurrentBackBufferRTV();
+    // Occlusion culling renders the scene into its own depth buffer that can be read by shaders
+    auto* pDSV = m_SceneDepthDSV ? m_SceneDepthDSV.RawPtr() : m_pSwapChain->GetDepthBufferDSV();
+    if (m_IdleMode && m_FrameCacheRTV)
     {
-        // Map the buffer and write current world-view-projection matrix
-        MapHelper<float4x4> CBConstants(m_pImmediateContext, m_VSConstants, MAP_WRITE, MAP_FLAG_DISCARD);
-        CBConstants[0] = m_ViewProjMatrix;
-        CBConstants[1] = m_RotationMatrix;
+        // The scene is only rendered to the cache when something has changed since the
+        // last frame. Otherwise the previous frame is reused.
+        if (!m_FrameCacheValid)
+        {
+            // Occlusion culling needs the depth of the cached frame as well, so it is rendered to the scene
+            // depth buffer when culling is enabled. Both buffers have the size of the swap chain.
+            RenderScene(m_FrameCacheRTV, m_SceneDepthDSV ? m_SceneDepthDSV.RawPtr() : m_FrameCacheDSV.RawPtr());
+            m_Benchmark.AddSample("SubmitDraws", m_SubmitTime * 1000.0);
+            m_FrameCacheValid = true;
+
+            // The cache stays in the shader resource state until it is rendered to again
+            StateTransitionDesc Barrier{m_FrameCacheRTV->GetTexture(), RESOURCE_STATE_UNKNOWN, RESOURCE_STATE_SHADER_RESOURCE, STATE_TRANSITION_FLAG_UPDATE_STATE};
+            m_pImmediateContext->TransitionResourceStates(1, &Barrier);
+        }
+        else
+        {
+            ++m_NumCachedFrames;
+        }
+        T4_PROFILE_COUNTER("CachedFrames", m_NumCachedFrames);
+        BlitFrameCache(pRTV);
     }
+    else
+    {
+        RenderScene(pRTV, pDSV);
+        m_Benchmark.AddSample("SubmitDraws", m_SubmitTime * 1000.0);
+    }
+
+    // Resources of this frame can be reused once the GPU reaches this fence value
+    m_FrameResources[m_FrameResIndex].FenceValue = m_NextFenceValue;
+    m_pImmediateContext->EnqueueSignal(m_pFrameFence, m_NextFenceValue++);
+
+    m_Benchmark.AddSample("Render", RenderTimer.GetElapsedTime() * 1000.0);
+    T4_PROFILE_ZONE_END("Render");
+    T4_PROFILE_ZONE_BEGIN("Present");
+    m_PresentEventOpen = true;
 
-    // Bind vertex, instance and index buffers
-    const Uint64 offsets[] = {0, 0};
-    IBuffer*     pBuffs[]  = {m_CubeVertexBuffer, m_InstanceBuffer};
-    m_pImmediateContext->SetVertexBuffers(0, _countof(pBuffs), pBuffs, offsets, RESOURCE_STATE_TRANSITION_MODE_TRANSITION, SET_VERTEX_BUFFERS_FLAG_RESET);
-    m_pImmediateContext->SetIndexBuffer(m_CubeIndexBuffer, 0, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+    if (m_Benchmark.IsRunning() && !m_Benchmark.NextFrame())
+        FinishBenchmark();
+}
 
-    // Set the pipeline state
-    m_pImmediateContext->SetPipelineState(m_pPSO);
-    // Commit shader resources. RESOURCE_STATE_TRANSITION_MODE_TRANSITION mode
-    // makes sure that resources are transitioned to required states.
-    m_pImmediateContext->CommitShaderResources(m_SRB, RESOURCE_STATE_TRANSITION_MODE_TRANSITION);
+void Tutorial04_Instancing::ApplyRecordedSettings(const RecordedFrame& Frame)
+{
+    m_MobileInstancing = std::clamp(Frame.MobileInstancing, 0, MOBILE_INSTANCING_COUNT - 1);
+    m_AnimateMobile    = Frame.Animate;
+    m_DepthSort        = Frame.DepthSort;
+    m_DepthPrepass     = Frame.DepthPrepass;
 
-    DrawIndexedAttribs DrawAttrs;       // This is an indexed draw call
-    DrawAttrs.IndexType    = VT_UINT32; // Index type
-    DrawAttrs.NumIndices   = 36;
-    DrawAttrs.NumInstances = m_GridSize * m_GridSize * m_GridSize; // The number of instances
-    // Verify the state of vertex and index buffers
-    DrawAttrs.Flags = DRAW_FLAG_VERIFY_ALL;
-    m_pImmediateContext->DrawIndexed(DrawAttrs);
+    // A replay recorded on a device with more features would not produce the same frames
+    if ((Frame.VertexPulling && !m_VertexPullingSupported) || (Frame.OcclusionCulling && !m_pCullPSO))
+    {
+        if (!m_ReplaySettingsMismatch)
+            LOG_WARNING_MESSAGE("The frame log uses features that are not supported by this device. Replayed frames will differ from the recorded ones.");
+        m_ReplaySettingsMismatch = true;
+    }
+    m_VertexPulling    = Frame.VertexPulling && m_VertexPullingSupported;
+    m_OcclusionCulling = Frame.OcclusionCulling && m_pCullPSO;
 }
 
 void Tutorial04_Instancing::Update(double CurrTime, double ElapsedTime)
 {
+    if (m_PresentEventOpen)
+    {
+        T4_PROFILE_ZONE_END("Present");
+        m_PresentEventOpen = false;
+    }
+    if (m_BenchmarkFinished)
+        ExitAfterBenchmark();
+
+    T4_PROFILE_FRAME_MARK();
+    T4_PROFILE_ZONE("Update");
+    Timer UpdateTimer;
+
+    const double FrameStartTime = m_FrameTimer.GetElapsedTime();
+    if (m_LastFrameStartTime >= 0)
+        m_Benchmark.AddSample("Frame", (FrameStartTime - m_LastFrameStartTime) * 1000.0);
+    m_LastFrameStartTime = FrameStartTime;
+
+    // When replaying, the recorded time and UI state replace the live ones
+    RecordedFrame Frame;
+    const bool    IsReplayFrame = m_FrameRecorder.IsReplaying() && m_FrameRecorder.ReplayFrame(Frame);
+    if (IsReplayFrame)
+    {
+        CurrTime    = Frame.CurrTime;
+        ElapsedTime = Frame.ElapsedTime;
+        // The recorded time is usually earlier than the time of the running simulation, and the
+        // simulation continues from the angle the recording started at
+        if (m_FrameRecorder.GetReplayPosition() == 1)
+            m_Simulation->Reset(CurrTime, Frame.HasMobileAngle ? Frame.MobileAngle : m_MobileAngle);
+    }
+
     SampleBase::Update(CurrTime, ElapsedTime);
     UpdateUI();
-    PopulateInstanceBuffer();
+
+    if (IsReplayFrame)
+    {
+        m_CameraMode = Frame.CameraMode;
+        m_GridSize   = std::clamp(Frame.GridSize, 1, MaxGridSize);
+        m_SceneMode  = std::clamp(Frame.SceneMode, 0, SCENE_MODE_COUNT - 1);
+        m_NumMobiles = std::clamp(Frame.NumMobiles, 1, MaxNumMobiles);
+        if (Frame.HasRenderSettings)
+            ApplyRecordedSettings(Frame);
+    }
+    else
+    {
+        Frame.CurrTime    = CurrTime;
+        Frame.ElapsedTime = ElapsedTime;
+        Frame.CameraMode  = m_CameraMode;
+        Frame.GridSize    = m_GridSize;
+        Frame.SceneMode   = m_SceneMode;
+        Frame.NumMobiles  = m_NumMobiles;
+
+        Frame.HasRenderSettings = true;
+        Frame.MobileInstancing  = m_MobileInstancing;
+        Frame.Animate           = m_AnimateMobile;
+        Frame.VertexPulling     = m_VertexPulling;
+        Frame.DepthSort         = m_DepthSort;
+        Frame.DepthPrepass      = m_DepthPrepass;
+        Frame.OcclusionCulling  = m_OcclusionCulling;
+    }
+    m_UseReplayMobileAngle = IsReplayFrame && Frame.HasMobileAngle;
+    m_ReplayMobileAngle    = Frame.MobileAngle;
+
+    if (m_Benchmark.IsRunning() && !m_ReplayFilePath.empty() && !IsReplayFrame)
+    {
+        // The frame log is exhausted
+        FinishBenchmark();
+    }
+
+    {
+        Timer PopulateTimer;
+        PopulateInstanceBuffer(CurrTime);
+        m_Benchmark.AddSample("PopulateInstanceBuffer", PopulateTimer.GetElapsedTime() * 1000.0);
+    }
+
+    // The frame is recorded once the angle of the mobiles is known
+    Frame.HasMobileAngle = true;
+    Frame.MobileAngle    = m_MobileAngle;
+    m_FrameRecorder.RecordFrame(Frame);
+
+    // Move the camera away to fit large scenes
+    const float SceneExtent    = GetSceneExtent();
+    const float CameraDistance = std::max(40.f, 2.5f * SceneExtent);
 
     float4x4 View;
 
@@ -298,23 +2190,23 @@ void Tutorial04_Instancing::Update(double CurrTime, double ElapsedTime)
     {
         default:
         case 0:
-            View = float4x4::RotationX(-0.3f) * float4x4::Translation(0.f, 0.f, 40.0f);
+            View = float4x4::RotationX(-0.3f) * float4x4::Translation(0.f, 0.f, CameraDistance);
             break;
 
         case 1:
-            View = float4x4::Translation(0.f, 0.f, 40.f);
+            View = float4x4::Translation(0.f, 0.f, CameraDistance);
             break;
 
         case 2:
-            View = float4x4::RotationX(-PI_F/2.0f) * float4x4::Translation(0.f, 0.f, 40.f);
+            View = float4x4::RotationX(-PI_F/2.0f) * float4x4::Translation(0.f, 0.f, CameraDistance);
             break;
 
         case 3:
-            View = float4x4::RotationY(PI_F/2.0f) * float4x4::Translation(0.f, 0.f, 40.f);
+            View = float4x4::RotationY(PI_F/2.0f) * float4x4::Translation(0.f, 0.f, CameraDistance);
             break;
 
         case 4:
-            View = float4x4::RotationX(PI_F / 2.0f) * float4x4::Translation(0.f, 0.f, 40.f);
+            View = float4x4::RotationX(PI_F / 2.0f) * float4x4::Translation(0.f, 0.f, CameraDistance);
             break;
     }
 
@@ -322,7 +2214,7 @@ void Tutorial04_Instancing::Update(double CurrTime, double ElapsedTime)
     auto SrfPreTransform = GetSurfacePretransformMatrix(float3{0, 0, 1});
 
     // Proyeccin ajustada a la ventana
-    auto Proj = GetAdjustedProjectionMatrix(PI_F / 4.0f, 0.1f, 100.f);
+    auto Proj = GetAdjustedProjectionMatrix(PI_F / 4.0f, 0.1f, std::max(100.f, CameraDistance + 2.f * SceneExtent));
 
     // Multiplicamos todo
     m_ViewProjMatrix = View * SrfPreTransform * Proj;
@@ -330,6 +2222,13 @@ void Tutorial04_Instancing::Update(double CurrTime, double ElapsedTime)
     // Rotacin global (si la deseas). Aqu la dejamos en 0
     m_RotationMatrix = float4x4::RotationY(static_cast<float>(CurrTime) * 0.f) *
         float4x4::RotationX(static_cast<float>(CurrTime) * 0.f);
+    VERIFY(UseGlobalRotation || m_RotationMatrix == float4x4::Identity(), "Non-identity global rotation requires UseGlobalRotation");
+
+    UpdateInstanceOrder();
+    UpdateOcclusionCulling();
+    UpdateFrameCache();
+
+    m_Benchmark.AddSample("Update", UpdateTimer.GetElapsedTime() * 1000.0);
 }
 
 } // namespace Diligent
\ No newline at end of file
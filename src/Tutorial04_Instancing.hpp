@@ -27,15 +27,48 @@
 
 #pragma once
 
+#include <array>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "SampleBase.hpp"
 #include "BasicMath.hpp"
+#include "Profiler.hpp"
+#include "ProfilerOverlay.hpp"
+#include "TraceRecorder.hpp"
+#include "FrameRecorder.hpp"
+#include "Benchmark.hpp"
+#include "JobSystem.hpp"
+#include "MobileTemplate.hpp"
+#include "MobileSimulation.hpp"
+#include "DepthSorter.hpp"
+#include "Timer.hpp"
+#include "DurationQueryHelper.hpp"
+
+// Draw validation can only be selected at run time when T4_DRAW_VALIDATION_ENABLED is 1
+#ifndef T4_DRAW_VALIDATION_ENABLED
+#    define T4_DRAW_VALIDATION_ENABLED 1
+#endif
 
 namespace Diligent
 {
 
+namespace TexturedCube
+{
+struct CreatePSOInfo;
+}
+
 class Tutorial04_Instancing final : public SampleBase
 {
 public:
+    ~Tutorial04_Instancing();
+
+    virtual CommandLineStatus ProcessCommandLine(int argc, const char* const* argv) override final;
+
+    virtual void ModifyEngineInitInfo(const ModifyEngineInitInfoAttribs& Attribs) override final;
+
     virtual void Initialize(const SampleInitInfo& InitInfo) override final;
 
     virtual void Render() override final;
@@ -44,25 +77,373 @@ public:
     virtual const Char* GetSampleName() const override final { return "Tutorial04: Instancing"; }
 
 private:
+    // Passes that a cube pipeline is created for
+    enum CUBE_PASS : int
+    {
+        // Depth test and shading in one pass
+        CUBE_PASS_COLOR = 0,
+        // Depth pre-pass without a pixel shader
+        CUBE_PASS_DEPTH_ONLY,
+        // Shading of the fragments whose depth is equal to the depth written by the pre-pass
+        CUBE_PASS_DEPTH_EQUAL,
+        CUBE_PASS_COUNT
+    };
+    // Pipelines of the depth pre-pass that are derived from one color pipeline
+    struct PrepassPipelines
+    {
+        RefCntAutoPtr<IPipelineState> pDepthPSO;
+        RefCntAutoPtr<IPipelineState> pEqualPSO;
+        // Binding of the depth-only pipeline. The color binding is compatible with the equal pipeline.
+        RefCntAutoPtr<IShaderResourceBinding> pDepthSRB;
+    };
+
     void CreatePipelineState();
+    // Creates the pipeline that reads instance data from a structured buffer
+    RefCntAutoPtr<IPipelineState> CreatePullPipelineState(IShaderSourceInputStreamFactory* pShaderSourceFactory, bool UseInstanceIndices, CUBE_PASS Pass = CUBE_PASS_COLOR);
+    // Creates the pre-pass pipelines with the same shaders and layout as the TexturedCube pipeline
+    void CreatePrepassPipelines(const TexturedCube::CreatePSOInfo& CubePsoCI, PrepassPipelines& Pipelines);
+    RefCntAutoPtr<IPipelineState> CreateCubePassPipelineState(const TexturedCube::CreatePSOInfo& CubePsoCI, CUBE_PASS Pass);
+    void                          SetCubePassStates(GraphicsPipelineDesc& GraphicsPipeline, CUBE_PASS Pass) const;
+    void CreateBlitPipelineState(IShaderSourceInputStreamFactory* pShaderSourceFactory);
+    void CreatePlacementBuffer();
+    void BindConstantBuffers(IPipelineState* pPSO);
+    void UpdateConstantBuffers();
+    void UpdateConstantBuffer(IBuffer* pBuffer, const void* pData, Uint64 Size);
+    // Puts the buffer into its final state, so that the render loop only needs to verify it
+    void TransitionBufferState(IBuffer* pBuffer, RESOURCE_STATE NewState);
+    void CreateSplitInstanceStreams();
+    void UpdateDynamicInstanceStream();
     void CreateInstanceBuffer();
+    struct FrameResources;
+    // Advances to the resources of the next frame and waits until the GPU is done with them
+    FrameResources& AcquireFrameResources();
+    // Returns true if the buffer has been recreated
+    bool ReserveInstanceBuffer(FrameResources& Res, Uint64 NumInstances);
+    void BuildDrawPackets(FrameResources& Res);
+    // Sorts the instances front to back when the camera or the layout changes and uploads the order
+    void UpdateInstanceOrder();
+    void CreateOcclusionCullingPipelines(IShaderSourceInputStreamFactory* pShaderSourceFactory);
+    void CreateHiZ(Uint32 Width, Uint32 Height);
+    void UpdateOcclusionCulling();
+    bool UseOcclusionCulling(const FrameResources& Res) const;
+    // Writes the indices of the visible instances and the arguments of the indirect draw
+    void CullInstances(FrameResources& Res);
+    // Builds the hierarchical depth buffer from the depth of the rendered scene
+    void BuildHiZ(ITextureView* pDSV);
+    // Reads the number of visible instances back once the GPU has finished the frame
+    void ReadCullingStats(FrameResources& Res);
     void UpdateUI();
-    void PopulateInstanceBuffer();
+    // Restores the render settings of a replayed frame
+    void ApplyRecordedSettings(const RecordedFrame& Frame);
+    void RenderScene(ITextureView* pRTV, ITextureView* pDSV);
+    // Replays the draw packets with the pipelines of the given pass and returns the number of instances
+    Uint32 SubmitDrawPackets(const FrameResources& Res, CUBE_PASS Pass, DrawIndexedAttribs& DrawAttrs, RESOURCE_STATE_TRANSITION_MODE StateMode);
+    void CreateFrameCache(Uint32 Width, Uint32 Height);
+    void UpdateFrameCache();
+    void BlitFrameCache(ITextureView* pRTV);
+    void PopulateInstanceBuffer(double CurrTime);
+    void   GeneratePlacements();
+    void   GenerateInstanceData(float Angle, JobSystem& Jobs, std::vector<float4x4>& InstanceData) const;
+    void   GenerateMobileInstances(float Angle, JobSystem& Jobs, float4x4* pDst) const;
+    Uint32 GetSceneGridSize() const;
+    Uint32 GetSceneNumMobiles() const;
+    size_t GetNumCPUMobileInstances() const;
+    // Half-size of the scene in the XZ plane, not counting the central mobile
+    float GetSceneExtent() const;
+
+    static void GenerateGridInstances(Uint32 GridSize, JobSystem& Jobs, float4x4* pDst);
+    void FinishBenchmark();
+    // Stops the worker threads, flushes the outputs and exits with the benchmark result
+    void ExitAfterBenchmark();
 
     RefCntAutoPtr<IPipelineState>         m_pPSO;
     RefCntAutoPtr<IBuffer>                m_CubeVertexBuffer;
     RefCntAutoPtr<IBuffer>                m_CubeIndexBuffer;
-    RefCntAutoPtr<IBuffer>                m_InstanceBuffer;
-    RefCntAutoPtr<IBuffer>                m_VSConstants;
+    // Constant buffers grouped by update frequency, see cube_constants.fxh
+    RefCntAutoPtr<IBuffer>                m_ViewConstants;
+    RefCntAutoPtr<IBuffer>                m_FrameConstants;
+    RefCntAutoPtr<IBuffer>                m_StaticConstants;
     RefCntAutoPtr<ITextureView>           m_TextureSRV;
     RefCntAutoPtr<IShaderResourceBinding> m_SRB;
+    PrepassPipelines                      m_Prepass;
+    // Shaders and textures are loaded from the working directory unless another directory is given
+    std::string m_AssetDir;
+
+    enum DRAW_VALIDATION : int
+    {
+        // Neither resource states nor draw commands are verified
+        DRAW_VALIDATION_NONE = 0,
+        // States of bound resources are verified
+        DRAW_VALIDATION_STATES,
+        // Draw commands are verified too
+        DRAW_VALIDATION_FULL,
+        DRAW_VALIDATION_COUNT
+    };
+    int m_DrawValidation = T4_DRAW_VALIDATION_ENABLED ? DRAW_VALIDATION_FULL : DRAW_VALIDATION_NONE;
+
+    DRAW_FLAGS                     GetDrawFlags() const;
+    RESOURCE_STATE_TRANSITION_MODE GetStateTransitionMode() const;
+
+    enum MOBILE_INSTANCING : int
+    {
+        // Parts of all mobiles are expanded into matrices on the CPU
+        MOBILE_INSTANCING_CPU_MATRICES = 0,
+        // The vertex shader composes part transforms with mobile placements
+        MOBILE_INSTANCING_GPU_TEMPLATE,
+        // Static part attributes and per-mobile angles come from two vertex streams
+        MOBILE_INSTANCING_SPLIT_STREAMS,
+        MOBILE_INSTANCING_COUNT
+    };
+    int m_MobileInstancing = MOBILE_INSTANCING_CPU_MATRICES;
+
+    // Two-level instancing
+    RefCntAutoPtr<IPipelineState>         m_pMobilePSO;
+    RefCntAutoPtr<IShaderResourceBinding> m_MobileSRB;
+    PrepassPipelines                      m_MobilePrepass;
+    RefCntAutoPtr<IBuffer>                m_MobileTemplateCB;
+    RefCntAutoPtr<IBuffer>                m_PlacementBuffer;
+
+    // Split instance streams
+    RefCntAutoPtr<IPipelineState>         m_pSplitPSO;
+    RefCntAutoPtr<IShaderResourceBinding> m_SplitSRB;
+    PrepassPipelines                      m_SplitPrepass;
+    RefCntAutoPtr<IBuffer>                m_StaticInstanceStream;
+    RefCntAutoPtr<IBuffer>                m_DynamicInstanceStream;
+
+    // Vertex pulling: instance matrices are read from a structured buffer indexed by the instance ID
+    RefCntAutoPtr<IPipelineState> m_pPullPSO;
+    bool                          m_VertexPullingSupported = false;
+    bool                          m_VertexPulling          = false;
+    // Same pipeline that maps the instance ID through g_InstanceIndices
+    RefCntAutoPtr<IPipelineState> m_pPullIndexedPSO;
+    // Bindings of the vertex pulling pre-pass pipelines are created per frame with the instance buffers
+    PrepassPipelines m_PullPrepass;
+    PrepassPipelines m_PullIndexedPrepass;
+
+    // Front-to-back instance order for early depth testing. The order is only recomputed
+    // when the camera or the scene layout changes.
+    DepthSorter m_DepthSorter;
+    bool        m_DepthSort       = false;
+    Uint64      m_OrderGeneration = 0;
+    Uint64      m_SortedLayout    = ~Uint64{0};
+    float4x4    m_SortedViewProj;
+
+    // Hi-Z occlusion culling: a compute pass removes the instances whose bounding boxes are hidden
+    // behind the depth of the previous frame and writes the instance count of an indirect draw
+    bool                                     m_OcclusionCulling = false;
+    RefCntAutoPtr<IPipelineState>            m_pHiZBuildPSO;
+    RefCntAutoPtr<IShaderResourceBinding>    m_HiZBuildSRB;
+    RefCntAutoPtr<IPipelineState>            m_pCullPSO;
+    RefCntAutoPtr<IBuffer>                   m_CullConstants;
+    // The swap chain depth buffer may not be readable, so the scene is rendered to its own depth buffer
+    RefCntAutoPtr<ITextureView>              m_SceneDepthDSV;
+    RefCntAutoPtr<ITexture>                  m_HiZ;
+    std::vector<RefCntAutoPtr<ITextureView>> m_HiZMipSRVs;
+    std::vector<RefCntAutoPtr<ITextureView>> m_HiZMipUAVs;
+    // The depth buffer is only used for the scene layout it was built with
+    bool     m_HiZValid  = false;
+    Uint64   m_HiZLayout = ~Uint64{0};
+    float4x4 m_HiZViewProj;
+    Uint32   m_NumTestedInstances  = 0;
+    Uint32   m_NumVisibleInstances = 0;
+    Uint32   m_NumCulledInstances  = 0;
 
     float4x4             m_ViewProjMatrix;
     float4x4             m_RotationMatrix;
+
+    // The global rotation is identity, so the shaders skip it.
+    // Must match USE_GLOBAL_ROTATION in cube_constants.fxh.
+    static constexpr bool UseGlobalRotation = false;
+
+    // Contents of the constant buffers, so that every buffer is only written when its contents change
+    float4x4 m_UploadedViewProj;
+    float4x4 m_UploadedRotation;
+    float    m_UploadedMobileAngle = 0;
+    bool     m_ConstantsUploaded   = false;
+
     int                  m_GridSize   = 32;
-    static constexpr int MaxGridSize  = 32;
-    static constexpr int MaxInstances = MaxGridSize * MaxGridSize * MaxGridSize;
+    static constexpr int MaxGridSize  = 128;
     int                  m_CameraMode = 0;
+
+    enum SCENE_MODE : int
+    {
+        // The mobile only
+        SCENE_MODE_MOBILE = 0,
+        // The mobile inside a randomized GridSize^3 grid of cubes
+        SCENE_MODE_GRID_STRESS,
+        // NumMobiles mobiles with random phases on a square layout
+        SCENE_MODE_MANY_MOBILES,
+        SCENE_MODE_COUNT
+    };
+    int                  m_SceneMode   = SCENE_MODE_MOBILE;
+    int                  m_NumMobiles  = 1000;
+    static constexpr int MaxNumMobiles = 10000;
+
+    // Scene layout of the generated instance data. Placements and the grid are regenerated when it changes.
+    struct SceneLayout
+    {
+        int    SceneMode        = -1;
+        Uint32 GridSize         = 0;
+        Uint32 NumMobiles       = 0;
+        int    MobileInstancing = -1;
+
+        bool operator!=(const SceneLayout& RHS) const
+        {
+            return SceneMode != RHS.SceneMode || GridSize != RHS.GridSize || NumMobiles != RHS.NumMobiles || MobileInstancing != RHS.MobileInstancing;
+        }
+    };
+    SceneLayout GetSceneLayout() const;
+    SceneLayout m_GeneratedLayout;
+
+    // Idle mode: the scene is rendered to the frame cache only when it changes, and the cache
+    // is copied to the back buffer in all other frames
+    struct FrameState
+    {
+        float4x4    ViewProj;
+        float4x4    Rotation;
+        float       MobileAngle            = 0;
+        Uint64      InstanceDataGeneration = 0;
+        SceneLayout Layout;
+        bool        VertexPulling = false;
+
+        bool operator!=(const FrameState& RHS) const
+        {
+            return ViewProj != RHS.ViewProj || Rotation != RHS.Rotation || MobileAngle != RHS.MobileAngle ||
+                InstanceDataGeneration != RHS.InstanceDataGeneration || Layout != RHS.Layout || VertexPulling != RHS.VertexPulling;
+        }
+    };
+    RefCntAutoPtr<IPipelineState>         m_pBlitPSO;
+    RefCntAutoPtr<IShaderResourceBinding> m_BlitSRB;
+    RefCntAutoPtr<ITextureView>           m_FrameCacheRTV;
+    RefCntAutoPtr<ITextureView>           m_FrameCacheDSV;
+    FrameState                            m_CachedFrameState;
+    bool                                  m_IdleMode        = false;
+    bool                                  m_FrameCacheValid = false;
+    Uint64                                m_NumCachedFrames = 0;
+
+    // Placements of all mobiles in the scene. Mobile parts are expanded into instances every frame.
+    std::vector<MobilePlacement> m_Placements;
+
+    // One draw of the scene with everything it binds. The draw sequence only changes when
+    // buffers or pipelines are recreated, so it is built once and replayed every frame.
+    struct DrawPacket
+    {
+        static constexpr Uint32 MaxVertexBuffers = 3;
+
+        // Pipelines and bindings of every pass, indexed by CUBE_PASS
+        std::array<IPipelineState*, CUBE_PASS_COUNT>         PSOs             = {};
+        std::array<IShaderResourceBinding*, CUBE_PASS_COUNT> SRBs             = {};
+        std::array<IBuffer*, MaxVertexBuffers>               VertexBuffers    = {};
+        Uint32                                               NumVertexBuffers = 0;
+        Uint32                                               NumInstances     = 0;
+        // Arguments of an indirect draw that replaces NumInstances
+        IBuffer* pIndirectArgs = nullptr;
+    };
+    // Resources that the CPU writes for one frame while the GPU may still be reading the resources
+    // of previous frames. A set is reused once the GPU has reached its fence value.
+    struct FrameResources
+    {
+        RefCntAutoPtr<IBuffer> pInstanceBuffer;
+        // Capacity of the instance buffer, in instances
+        Uint64 InstanceBufferCapacity = 0;
+        bool   IsStructured           = false;
+        // Generations of the instance data and of the scene layout in the buffer
+        Uint64 UploadedGeneration = ~Uint64{0};
+        Uint64 UploadedLayout     = ~Uint64{0};
+        Uint64 FenceValue         = 0;
+        // Binds the instance buffer to the vertex pulling pipeline
+        RefCntAutoPtr<IShaderResourceBinding> pPullSRB;
+        RefCntAutoPtr<IShaderResourceBinding> pPullDepthSRB;
+        // Front-to-back instance order and the binding that reads the instances through it
+        RefCntAutoPtr<IBuffer>                pOrderBuffer;
+        RefCntAutoPtr<IShaderResourceBinding> pSortedPullSRB;
+        RefCntAutoPtr<IShaderResourceBinding> pSortedPullDepthSRB;
+        Uint64                                UploadedOrder = ~Uint64{0};
+        // Occlusion culling: indices of the visible instances, arguments of the indirect draw and
+        // their CPU copy, and the bindings that read the visible instances
+        RefCntAutoPtr<IBuffer>                pVisibleBuffer;
+        RefCntAutoPtr<IBuffer>                pDrawArgsBuffer;
+        RefCntAutoPtr<IBufferView>            pDrawArgsUAV;
+        RefCntAutoPtr<IBuffer>                pDrawArgsReadback;
+        RefCntAutoPtr<IShaderResourceBinding> pCullSRB;
+        RefCntAutoPtr<IShaderResourceBinding> pCulledPullSRB;
+        RefCntAutoPtr<IShaderResourceBinding> pCulledPullDepthSRB;
+        Uint32                                NumCullTestedInstances = 0;
+        bool                                  CullStatsPending       = false;
+        // Draw sequence that uses the instance buffer and the scene layout it was built for
+        std::vector<DrawPacket> DrawPackets;
+        Uint64                  DrawPacketsLayout = ~Uint64{0};
+        bool                    DrawPacketsDirty  = true;
+        bool                    DrawPacketsSorted = false;
+        bool                    DrawPacketsCulled = false;
+    };
+    static constexpr Uint32                       MaxFramesInFlight = 4;
+    std::array<FrameResources, MaxFramesInFlight> m_FrameResources;
+    Uint32                                        m_NumFramesInFlight = 2;
+    Uint32                                        m_FrameResIndex     = 0;
+    RefCntAutoPtr<IFence>                         m_pFrameFence;
+    Uint64                                        m_NextFenceValue         = 1;
+    Uint64                                        m_NumFrameResourceStalls = 0;
+    // CPU time of submitting the draw packets of the last rendered frame, in seconds
+    double m_SubmitTime = 0;
+
+    // Depth pre-pass: the scene is drawn to the depth buffer first, so that the pixel shader
+    // only runs once per pixel in the color pass
+    bool m_DepthPrepass = false;
+    // GPU time of the scene with and without the pre-pass, and of the pre-pass alone, in seconds.
+    // Every mode has its own queries, so that results that arrive after a switch are not mixed up.
+    std::array<std::unique_ptr<DurationQueryHelper>, 2> m_SceneGpuTimers;
+    std::unique_ptr<DurationQueryHelper>                m_PrepassGpuTimer;
+    std::array<double, 2>                               m_SceneGpuTime   = {};
+    double                                              m_PrepassGpuTime = 0;
+
+    static constexpr Uint64 MinInstanceBufferCapacity = 64;
+
+    float                 m_MobileAngle   = PI_F / 4;
+    bool                  m_AnimateMobile = true;
+    std::vector<float4x4> m_InstanceData;
+
+    // Generation of the instance data is incremented whenever the data changes, so that
+    // uploads of data that is already in the instance buffer can be skipped
+    Uint64 m_InstanceDataGeneration = 0;
+    Uint64 m_LayoutGeneration       = 0;
+    float  m_GeneratedAngle         = 0;
+    Uint64 m_NumUploadChecks        = 0;
+    Uint64 m_NumSkippedUploads      = 0;
+
+    // Instance generation is split into chunks that run on the job system
+    std::unique_ptr<JobSystem> m_JobSystem;
+    Uint32                     m_NumWorkerThreads = JobSystem::DefaultNumWorkers;
+
+    // Mobile animation runs on its own thread and is consumed as snapshots
+    std::unique_ptr<MobileSimulation> m_Simulation;
+
+    // Profiler sinks: the frame loop timeline that can be dumped as a Chrome trace
+    // and the overlay in the Settings window
+    TraceRecorder   m_Trace;
+    ProfilerOverlay m_ProfilerOverlay;
+    std::string     m_TraceFilePath = "Tutorial04_Instancing.trace.json";
+    // Present is performed by the application after Render() returns, so the zone
+    // is opened at the end of Render() and closed at the beginning of the next Update().
+    bool m_PresentEventOpen = false;
+
+    // Per-frame UI state recording and replay for reproducible performance runs
+    FrameRecorder m_FrameRecorder;
+    std::string   m_RecordFilePath = "Tutorial04_Instancing.frames";
+    std::string   m_ReplayFilePath;
+    bool          m_RecordOnStart          = false;
+    bool          m_ReplaySettingsMismatch = false;
+    bool          m_UseReplayMobileAngle   = false;
+    float         m_ReplayMobileAngle      = 0;
+
+    // Headless benchmark with baseline comparison (--benchmark <frames>)
+    Benchmark           m_Benchmark;
+    Benchmark::Settings m_BenchSettings;
+    bool                m_RunBenchmark       = false;
+    bool                m_BenchmarkFinished  = false;
+    int                 m_BenchmarkExitCode  = EXIT_SUCCESS;
+    Timer               m_FrameTimer;
+    double              m_LastFrameStartTime = -1;
 };
 
 } // namespace Diligent
\ No newline at end of file